@@ -1,7 +1,13 @@
 
 #include "coarsening.h"
+#include "csr.h"
 #include "definition.h"
 #include "fm_partition.h"
+#include "gain_cache.h"
+#include "memory.h"
+#include "parallel.h"
+#include "parallel_fm.h"
+#include "trace.h"
 #include <algorithm>
 #include <assert.h>
 #include <cstddef>
@@ -9,10 +15,15 @@
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <random>
+#include <sstream>
 #include <utility>
 using namespace Partition;
 
+template <typename Graph>
+const typename Contraction<Graph>::IndexType Contraction<Graph>::NO_NET;
+
 Index randomNumberGenerator(Index lower, Index upper) {
   static std::default_random_engine rng(time(0));
 
@@ -20,193 +31,719 @@ Index randomNumberGenerator(Index lower, Index upper) {
   return dist(rng);
 }
 
-std::map<Index, int> Partition::Multilevel(HyperGraph &graph, float ratio,
-                                           size_t minimum_size) {
-  assert(ratio > 0 && ratio < 1);
-  std::set<Index> part_1;
-  std::set<Index> part_2;
-  auto getEdgeByOrderWeight = [&graph]() {
-    std::vector<Index> vec(graph.bitMatrix.size());
-    for (auto i = 0; i < vec.size(); i++) {
-      vec[i] = i;
-    }
-    std::sort(vec.begin(), vec.end(), [&graph](Index a, Index b) {
-      return (1 / (graph.bitMatrix[a].numberOfOnes() +
-                   graph.weight_of_edges->at(a) - 1)) <
-             (1 / (graph.bitMatrix[b].numberOfOnes() +
-                   graph.weight_of_edges->at(b) - 1));
-    });
-    return vec;
-  };
+/* edges ordered by 1 / (pins + weight - 1), the order in which clusters are
+ * grown and the initial partition is filled */
+template <typename Graph>
+static std::vector<typename Graph::index_type>
+edgesByOrderWeight(const Graph &graph) {
+  using IndexType = typename Graph::index_type;
+  std::vector<IndexType> vec(graph.edgeCount());
+  for (auto i = 0; i < vec.size(); i++) {
+    vec[i] = i;
+  }
+  std::sort(vec.begin(), vec.end(), [&graph](IndexType a, IndexType b) {
+    return (1 / (graph.pinCountOfEdge(a) + graph.weightOfEdge(a) - 1)) <
+           (1 / (graph.pinCountOfEdge(b) + graph.weightOfEdge(b) - 1));
+  });
+  return vec;
+}
 
-  if (graph.weight_of_nodes->size() > minimum_size) {
-    std::vector<std::vector<Index>> node_to_nodes_map;
-    std::vector<bitmap> node_to_nodes_map_bit;
-    std::map<size_t, std::pair<bitmap, std::vector<Index>>> edge_to_nodes_map;
-
-    std::vector<Index> sorted_edge = getEdgeByOrderWeight();
-    std::set<Index> node_used_checker;
-    size_t big_node = 0;
-    for (auto iter = sorted_edge.begin(); iter != sorted_edge.end(); iter++) {
-      if (node_to_nodes_map.size() == big_node) {
-        node_to_nodes_map.push_back(std::vector<Index>());
-      }
-
-      std::vector<Index> nodes = graph.bitMatrix[*iter].toVector();
-      for (auto n : nodes) {
-        if (node_used_checker.find(n) == node_used_checker.end()) {
-          node_used_checker.insert(n);
-          node_to_nodes_map[big_node].push_back(n);
-          if (node_to_nodes_map[big_node].size() >= minimum_size) {
-            big_node++;
-            /* just break, I will collect the nodes not used at next stage */
-            break;
-          }
+/* greedy bisection: the first part is filled with the pins of the nets in
+ * order, starting from the first-th one, the rest goes to the second part.
+ * FM refines it right away. */
+template <typename Graph>
+static void
+initialPartition(Graph &graph, float ratio,
+                 const std::vector<typename Graph::index_type> &sorted_edge,
+                 size_t first, std::set<typename Graph::index_type> &part_1,
+                 std::set<typename Graph::index_type> &part_2,
+                 GainCache<Graph> &gains) {
+  using IndexType = typename Graph::index_type;
+
+  std::vector<IndexType> unique_counter;
+  std::set<IndexType> node_used_checker;
+  for (size_t i = 0; i < sorted_edge.size(); i++) {
+    std::vector<size_t> nodes =
+        graph.pinsOfEdge(sorted_edge[(first + i) % sorted_edge.size()]);
+    for (auto n : nodes) {
+      if (node_used_checker.find(n) == node_used_checker.end()) {
+        node_used_checker.insert(n);
+        unique_counter.push_back(n);
+      }
+    }
+  }
+  /* nodes in no net still need a side, on a coarse level they stand for
+   * nodes which do have nets further up */
+  for (IndexType n = 0; n < graph.weight_of_nodes->size(); n++) {
+    if (node_used_checker.find(n) == node_used_checker.end()) {
+      unique_counter.push_back(n);
+    }
+  }
+
+  size_t total_area = 0;
+  for (auto i = 0; i < graph.weight_of_nodes->size(); i++) {
+    total_area += graph.weight_of_nodes->at(i);
+  }
+
+  size_t part_1_area = 0;
+  size_t part_2_area = 0;
+
+  /* fixed nodes start in their blocks, the free ones fill up around them */
+  for (IndexType n = 0; n < graph.fixed.size(); n++) {
+    if (graph.fixed[n] == 1) {
+      part_1.insert(n);
+      part_1_area += graph.weight_of_nodes->at(n);
+    } else if (graph.fixed[n] == 2) {
+      part_2.insert(n);
+      part_2_area += graph.weight_of_nodes->at(n);
+    }
+  }
+
+  for (auto iter = unique_counter.begin(); iter != unique_counter.end();
+       iter++) {
+    if (graph.isFixed(*iter)) {
+      continue;
+    }
+    if (part_1_area < total_area * ratio) {
+      part_1.insert(*iter);
+      part_1_area += graph.weight_of_nodes->at(*iter);
+    } else {
+      part_2.insert(*iter);
+      part_2_area += graph.weight_of_nodes->at(*iter);
+    }
+  }
+
+  gains.initialize(graph, part_1, part_2);
+  FM<Graph>(part_1, part_2, graph, ratio, 10, gains);
+}
+
+/* a level which hardly removes nodes costs a full FM pass for nothing */
+template <typename Graph>
+static bool shrinksEnough(const Graph &graph,
+                          const Contraction<Graph> &contraction,
+                          const MultilevelConfig &config) {
+  size_t nodes = graph.weight_of_nodes->size();
+  size_t coarse_nodes = contraction.clusters.size();
+  if (coarse_nodes < nodes && coarse_nodes <= nodes * (1 - config.min_shrink)) {
+    return true;
+  }
+  std::cout << "coarsening stops: " << nodes << " -> " << coarse_nodes
+            << " nodes" << std::endl;
+  return false;
+}
+
+template <typename Graph>
+std::shared_ptr<Contraction<Graph>>
+Partition::contract(const Graph &graph, const MultilevelConfig &config,
+                    size_t level, const std::vector<int> *blocks) {
+  using IndexType = typename Graph::index_type;
+  using WeightType = typename Graph::weight_type;
+
+  TRACE_SCOPE(contraction_span, "contraction");
+  TRACE_ARG(contraction_span, "level", level);
+  std::vector<std::vector<IndexType>> node_to_nodes_map;
+
+  std::vector<IndexType> sorted_edge = edgesByOrderWeight(graph);
+  std::vector<uint8_t> used(graph.weight_of_nodes->size(), 0);
+  size_t max_weight = config.max_cluster_weight;
+  /* nodes of different blocks never share a cluster, so every block (0 for
+   * all nodes without blocks) has its own open cluster, together with its
+   * weight and the block its fixed nodes are fixed to */
+  const size_t NO_CLUSTER = static_cast<size_t>(-1);
+  size_t open_cluster[3] = {NO_CLUSTER, NO_CLUSTER, NO_CLUSTER};
+  WeightType open_weight[3] = {0, 0, 0};
+  int open_fixed[3] = {0, 0, 0};
+  for (auto iter = sorted_edge.begin(); iter != sorted_edge.end(); iter++) {
+    std::vector<size_t> nodes = graph.pinsOfEdge(*iter);
+    for (auto n : nodes) {
+      if (used[n]) {
+        continue;
+      }
+      int block = blocks != nullptr ? blocks->at(n) : 0;
+      size_t &cluster = open_cluster[block];
+      WeightType weight = graph.weight_of_nodes->at(n);
+      if (cluster != NO_CLUSTER) {
+        /* too heavy for this cluster, it may still join another one */
+        if (max_weight > 0 && open_weight[block] + weight > max_weight) {
+          continue;
+        }
+        /* the same for a node fixed to the other block than a node of the
+         * cluster */
+        if (graph.isFixed(n) && open_fixed[block] != 0 &&
+            graph.fixed[n] != open_fixed[block]) {
+          continue;
         }
+      } else {
+        cluster = node_to_nodes_map.size();
+        node_to_nodes_map.push_back(std::vector<IndexType>());
+        open_weight[block] = 0;
+        open_fixed[block] = 0;
+      }
+      if (graph.isFixed(n)) {
+        open_fixed[block] = graph.fixed[n];
+      }
+      used[n] = 1;
+      node_to_nodes_map[cluster].push_back(n);
+      open_weight[block] += weight;
+      if (node_to_nodes_map[cluster].size() >= config.cluster_size ||
+          (max_weight > 0 && open_weight[block] >= max_weight)) {
+        cluster = NO_CLUSTER;
+        /* just break, I will collect the nodes not used at next stage */
+        break;
       }
     }
+  }
 
-    bitmap node_selected;
-    bitmap node_mask;
-    for (auto iter = node_used_checker.begin(); iter != node_used_checker.end();
-         iter++) {
-      node_selected.set(*iter);
+  /* the nodes left over stay on their own */
+  for (IndexType n = 0; n < used.size(); n++) {
+    if (!used[n]) {
+      node_to_nodes_map.push_back(std::vector<IndexType>({n}));
     }
+  }
 
-    for (auto i = 0; i < graph.weight_of_nodes->size(); i++) {
-      node_mask.set(i);
+  for (auto &nodes : node_to_nodes_map) {
+    std::sort(nodes.begin(), nodes.end());
+  }
+  /* clusters numbered by their smallest member keep the order of this
+   * level, nodes which were close stay close on the coarse level */
+  if (config.reorder) {
+    node_to_nodes_map.erase(
+        std::remove_if(node_to_nodes_map.begin(), node_to_nodes_map.end(),
+                       [](const std::vector<IndexType> &nodes) {
+                         return nodes.empty();
+                       }),
+        node_to_nodes_map.end());
+    std::sort(node_to_nodes_map.begin(), node_to_nodes_map.end(),
+              [](const std::vector<IndexType> &a,
+                 const std::vector<IndexType> &b) {
+                return a.front() < b.front();
+              });
+  }
+
+  std::vector<IndexType> cluster_of(graph.weight_of_nodes->size());
+  for (auto i = 0; i < node_to_nodes_map.size(); i++) {
+    for (auto n : node_to_nodes_map[i]) {
+      cluster_of[n] = i;
     }
+  }
 
-    std::vector<Index> nodes_left = (node_mask - node_selected).toVector();
-    for (auto n : nodes_left) {
-      node_to_nodes_map.push_back(std::vector<Index>({n}));
+  /* every other net gets its fine pins replaced by the sorted clusters they
+   * belong to */
+  size_t edges_count = graph.bitMatrix.size();
+  CSR<IndexType> coarse_pins = graph.pins;
+  std::vector<IndexType> coarse_size(edges_count);
+  std::vector<size_t> hash(edges_count, 0);
+  parallelFor(0, edges_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      auto first = coarse_pins.entries.begin() + coarse_pins.offsets[e];
+      auto last = coarse_pins.entries.begin() + coarse_pins.offsets[e + 1];
+      for (auto pin = first; pin != last; pin++) {
+        *pin = cluster_of[*pin];
+      }
+      std::sort(first, last);
+      coarse_size[e] = std::unique(first, last) - first;
+      for (auto pin = first; pin != first + coarse_size[e]; pin++) {
+        hash[e] = hash[e] * 1000003 ^ *pin;
+      }
     }
+  });
 
-    /* bad code, need to optimized, but for time */
-    /* I hit to write slow programs but I have to */
-    for (auto i = 0; i < node_to_nodes_map.size(); i++) {
-      std::sort(node_to_nodes_map[i].begin(), node_to_nodes_map[i].end());
-      bitmap temp;
-      for (auto n : node_to_nodes_map[i]) {
-        temp.set(n);
+  /* nets over the same clusters are merged, their weights add up. The nets
+   * are spread over buckets by their hash and every bucket finds its equal
+   * nets on its own, a net is merged into the first net equal to it. */
+  auto samePins = [&coarse_pins, &coarse_size](size_t a, size_t b) {
+    return coarse_size[a] == coarse_size[b] &&
+           std::equal(coarse_pins.entries.begin() + coarse_pins.offsets[a],
+                      coarse_pins.entries.begin() + coarse_pins.offsets[a] +
+                          coarse_size[a],
+                      coarse_pins.entries.begin() + coarse_pins.offsets[b]);
+  };
+  size_t buckets_count = std::max<size_t>(1, config.threads * 8);
+  std::vector<std::vector<IndexType>> buckets(buckets_count);
+  for (size_t e = 0; e < edges_count; e++) {
+    if (coarse_size[e] > 2) {
+      buckets[hash[e] % buckets_count].push_back(e);
+    }
+  }
+  std::vector<IndexType> merged_into(edges_count);
+  parallelFor(0, buckets_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t b = from; b < to; b++) {
+      std::vector<IndexType> &bucket = buckets[b];
+      std::sort(bucket.begin(), bucket.end(),
+                [&hash](IndexType x, IndexType y) {
+                  return hash[x] != hash[y] ? hash[x] < hash[y] : x < y;
+                });
+      for (size_t i = 0; i < bucket.size(); i++) {
+        merged_into[bucket[i]] = bucket[i];
+        for (size_t j = i; j > 0 && hash[bucket[j - 1]] == hash[bucket[i]];
+             j--) {
+          IndexType other = merged_into[bucket[j - 1]];
+          if (other == bucket[j - 1] && samePins(other, bucket[i])) {
+            merged_into[bucket[i]] = other;
+            break;
+          }
+        }
       }
-      node_to_nodes_map_bit.push_back(temp);
     }
+  });
 
-    /* another bad code */
-    std::map<int, int> weight_of_edges;
-    auto hash = [](size_t base, size_t value) {
-      static std::hash<size_t> hasher;
-      return base * 24 + hasher(value);
-    };
+  /* the remaining nets keep their order, their rows are copied in parallel */
+  std::vector<IndexType> position(edges_count + 1, 0);
+  parallelFor(0, edges_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      position[e + 1] = coarse_size[e] > 2 && merged_into[e] == e ? 1 : 0;
+    }
+  });
+  parallelPrefixSum(position, config.threads);
+  size_t nets_count = position[edges_count];
+  CSR<IndexType> coarse_nets;
+  coarse_nets.offsets.assign(nets_count + 1, 0);
+  std::vector<WeightType> result_edge_weight(nets_count, 0);
+  for (size_t e = 0; e < edges_count; e++) {
+    if (coarse_size[e] > 2) {
+      result_edge_weight[position[merged_into[e]]] +=
+          graph.weight_of_edges->at(e);
+      if (merged_into[e] == e) {
+        coarse_nets.offsets[position[e] + 1] = coarse_size[e];
+      }
+    }
+  }
+  parallelPrefixSum(coarse_nets.offsets, config.threads);
+  coarse_nets.entries.resize(coarse_nets.offsets.back());
+  parallelFor(0, edges_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      if (coarse_size[e] > 2 && merged_into[e] == e) {
+        auto first = coarse_pins.entries.begin() + coarse_pins.offsets[e];
+        std::copy(first, first + coarse_size[e],
+                  coarse_nets.entries.begin() +
+                      coarse_nets.offsets[position[e]]);
+      }
+    }
+  });
 
-    for (auto e : graph.bitMatrix) {
-      std::vector<Index> nodes;
-      size_t hash_value = 0;
-      bitmap mask;
-      for (auto i = 0; i < node_to_nodes_map_bit.size(); i++) {
-        if (!(e & node_to_nodes_map_bit[i]).empty()) {
-          nodes.push_back(i);
-          hash_value = hash(hash_value, i);
-          mask.set(i);
+  /* 2-pin kernel: the 2-pin nets and the nets left with two clusters are
+   * merged by their cluster pair, nets inside one cluster disappear. The
+   * pairs are spread over buckets by ranges of their first cluster, so the
+   * buckets sorted on their own give all pairs in order. */
+  size_t two_pin_count = graph.twoPinNets.size();
+  size_t candidates = two_pin_count + edges_count;
+  std::vector<std::pair<IndexType, IndexType>> cluster_pair(candidates);
+  parallelFor(0, candidates, config.threads, [&](size_t from, size_t to) {
+    for (size_t k = from; k < to; k++) {
+      IndexType u = 0;
+      IndexType v = 0;
+      if (k < two_pin_count) {
+        u = cluster_of[graph.twoPinNets.edges[k].first];
+        v = cluster_of[graph.twoPinNets.edges[k].second];
+      } else if (coarse_size[k - two_pin_count] == 2) {
+        auto first = coarse_pins.entries.begin() +
+                     coarse_pins.offsets[k - two_pin_count];
+        u = first[0];
+        v = first[1];
+      }
+      /* u == v marks no pair */
+      cluster_pair[k] = std::make_pair(std::min(u, v), std::max(u, v));
+    }
+  });
+  auto pairWeight = [&graph, two_pin_count](size_t k) -> WeightType {
+    return k < two_pin_count ? graph.twoPinNets.weights[k]
+                             : graph.weight_of_edges->at(k - two_pin_count);
+  };
+  size_t coarse_nodes = node_to_nodes_map.size();
+  std::vector<std::vector<IndexType>> pair_buckets(buckets_count);
+  for (size_t k = 0; k < candidates; k++) {
+    if (cluster_pair[k].first != cluster_pair[k].second) {
+      pair_buckets[size_t(cluster_pair[k].first) * buckets_count /
+                   coarse_nodes]
+          .push_back(k);
+    }
+  }
+  /* every bucket keeps the first net of each pair, with the summed weight */
+  std::vector<std::vector<WeightType>> pair_weights(buckets_count);
+  std::vector<IndexType> pair_position(buckets_count + 1, 0);
+  parallelFor(0, buckets_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t b = from; b < to; b++) {
+      std::vector<IndexType> &bucket = pair_buckets[b];
+      std::sort(bucket.begin(), bucket.end(),
+                [&cluster_pair](IndexType x, IndexType y) {
+                  return cluster_pair[x] != cluster_pair[y]
+                             ? cluster_pair[x] < cluster_pair[y]
+                             : x < y;
+                });
+      size_t kept = 0;
+      for (size_t i = 0; i < bucket.size(); i++) {
+        if (kept > 0 &&
+            cluster_pair[bucket[kept - 1]] == cluster_pair[bucket[i]]) {
+          pair_weights[b].back() += pairWeight(bucket[i]);
+        } else {
+          bucket[kept++] = bucket[i];
+          pair_weights[b].push_back(pairWeight(bucket[i]));
         }
       }
-      if (edge_to_nodes_map.find(hash_value) != edge_to_nodes_map.end()) {
-        weight_of_edges[hash_value] += 1;
-      } else {
-        weight_of_edges[hash_value] = 1;
-        edge_to_nodes_map.insert(
-            std::pair<size_t, std::pair<bitmap, std::vector<Index>>>(
-                hash_value,
-                std::pair<bitmap, std::vector<Index>>(mask, nodes)));
+      bucket.resize(kept);
+      pair_position[b + 1] = kept;
+    }
+  });
+  parallelPrefixSum(pair_position, config.threads);
+
+  /* the 2-pin rows go behind the others */
+  size_t pairs_count = pair_position[buckets_count];
+  size_t hyper_pins = coarse_nets.entries.size();
+  coarse_nets.offsets.resize(nets_count + pairs_count + 1);
+  coarse_nets.entries.resize(hyper_pins + 2 * pairs_count);
+  result_edge_weight.resize(nets_count + pairs_count);
+  parallelFor(0, buckets_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t b = from; b < to; b++) {
+      for (size_t i = 0; i < pair_buckets[b].size(); i++) {
+        size_t n = pair_position[b] + i;
+        auto &clusters = cluster_pair[pair_buckets[b][i]];
+        coarse_nets.entries[hyper_pins + 2 * n] = clusters.first;
+        coarse_nets.entries[hyper_pins + 2 * n + 1] = clusters.second;
+        coarse_nets.offsets[nets_count + n + 1] =
+            hyper_pins + 2 * (n + 1);
+        result_edge_weight[nets_count + n] = pair_weights[b][i];
       }
     }
+  });
 
-    /* construct a new HyperGraph */
-    std::vector<bitmap> result_matrix;
-    std::vector<int> result_node_weight;
-    std::vector<int> result_edge_weight;
-    for (auto iter : edge_to_nodes_map) {
-      if (iter.second.second.size() > 1) {
-        result_matrix.push_back(iter.second.first);
-        result_edge_weight.push_back(weight_of_edges.find(iter.first)->second);
+  /* construct a new HyperGraph */
+  std::vector<WeightType> result_node_weight;
+  for (auto &iter : node_to_nodes_map) {
+    WeightType area = 0;
+    for (auto n : iter) {
+      area += graph.weight_of_nodes->at(n);
+    }
+    result_node_weight.push_back(area);
+  }
+  std::shared_ptr<Contraction<Graph>> contraction(new Contraction<Graph>());
+  contraction->coarse_net.resize(edges_count);
+  parallelFor(0, edges_count, config.threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      contraction->coarse_net[e] = coarse_size[e] > 2
+                                       ? position[merged_into[e]]
+                                       : Contraction<Graph>::NO_NET;
+    }
+  });
+  contraction->graph.reset(new Graph(coarse_nets, result_edge_weight,
+                                     result_node_weight, config.threads));
+  /* a cluster with a fixed node is fixed to its block */
+  if (!graph.fixed.empty()) {
+    std::vector<int> &coarse_fixed = contraction->graph->fixed;
+    coarse_fixed.assign(node_to_nodes_map.size(), 0);
+    for (size_t c = 0; c < node_to_nodes_map.size(); c++) {
+      for (auto n : node_to_nodes_map[c]) {
+        if (graph.isFixed(n)) {
+          coarse_fixed[c] = graph.fixed[n];
+        }
       }
     }
+  }
 
-    for (auto iter : node_to_nodes_map) {
-      result_node_weight.push_back(iter.size());
+  size_t contraction_bytes =
+      used.capacity() * sizeof(uint8_t) +
+      (cluster_of.capacity() + coarse_size.capacity() +
+       merged_into.capacity() + position.capacity()) *
+          sizeof(IndexType) +
+      (hash.capacity() + edges_count) * sizeof(size_t) +
+      coarse_pins.memoryUsage() + coarse_nets.memoryUsage() +
+      cluster_pair.capacity() * sizeof(std::pair<IndexType, IndexType>) +
+      (candidates + pair_position.capacity()) * sizeof(IndexType) +
+      pairs_count * sizeof(WeightType);
+  /* the scratch above is freed on return, only the peak is kept */
+  MemoryRecord contraction_memory(COARSE_LEVELS, contraction_bytes);
+
+  TRACE_ARG(contraction_span, "coarse nodes", node_to_nodes_map.size());
+  contraction->clusters.swap(node_to_nodes_map);
+  return contraction;
+}
+
+template <typename Graph>
+Hierarchy<Graph> Partition::coarsen(const Graph &graph,
+                                    const MultilevelConfig &config) {
+  Hierarchy<Graph> hierarchy;
+  const Graph *current = &graph;
+  while (current->weight_of_nodes->size() > config.contraction_limit) {
+    std::shared_ptr<Contraction<Graph>> contraction =
+        contract(*current, config, hierarchy.size());
+    if (!shrinksEnough(*current, *contraction, config)) {
+      break;
     }
-    HyperGraph new_graph(result_matrix, result_edge_weight, result_node_weight);
+    hierarchy.push_back(contraction);
+    current = contraction->graph.get();
+  }
+  return hierarchy;
+}
 
-    std::map<Index, int> result = Multilevel(new_graph, ratio, minimum_size);
+template <typename Graph>
+size_t
+Partition::cutSize(const Graph &graph,
+                   const std::map<typename Graph::index_type, int> &blocks) {
+  /* get() on a bitmap is a scan, so the pins look their blocks up here */
+  std::vector<uint8_t> side(graph.weight_of_nodes->size(), 0);
+  for (auto n : blocks) {
+    side[n.first] = n.second;
+  }
+
+  size_t cut = 0;
+  auto &pins = graph.pins;
+  for (size_t e = 0; e < pins.rows(); e++) {
+    bool in_block[3] = {false, false, false};
+    for (auto p = pins.offsets[e]; p < pins.offsets[e + 1]; p++) {
+      in_block[side[pins.entries[p]]] = true;
+    }
+    if (in_block[1] && in_block[2]) {
+      cut++;
+    }
+  }
+  for (auto &e : graph.twoPinNets.edges) {
+    if (side[e.first] != 0 && side[e.second] != 0 &&
+        side[e.first] != side[e.second]) {
+      cut++;
+    }
+  }
+  return cut;
+}
+
+template <typename Graph>
+std::map<typename Graph::index_type, int>
+Partition::Multilevel(Graph &graph, const MultilevelConfig &config,
+                      size_t level, const Hierarchy<Graph> *hierarchy,
+                      GainCache<Graph> *gains, const std::vector<int> *blocks) {
+  using IndexType = typename Graph::index_type;
+
+  float ratio = config.ratio;
+  MemoryTracker &memory = MemoryTracker::instance();
+  /* the graph of the caller and the levels of a hierarchy are accounted by
+   * their owners, only the levels contracted here are counted */
+  MemoryRecord graph_memory(COARSE_LEVELS, level > 0 && hierarchy == nullptr
+                                               ? graph.memoryUsage()
+                                               : 0);
+  MemoryRecord partition_memory(PARTITIONS);
+
+  TRACE_SCOPE(level_span, "level");
+  TRACE_ARG(level_span, "level", level);
+  TRACE_ARG(level_span, "nodes", graph.weight_of_nodes->size());
+  TRACE_ARG(level_span, "edges", graph.edgeCount());
+
+  assert(ratio > 0 && ratio < 1);
+  assert(hierarchy == nullptr || blocks == nullptr);
+  std::set<IndexType> part_1;
+  std::set<IndexType> part_2;
+  /* the sequential FM keeps its gains across the levels */
+  bool sequential = config.threads <= 1;
+  GainCache<Graph> local_gains;
+  GainCache<Graph> &level_gains = gains != nullptr ? *gains : local_gains;
+
+  /* a given hierarchy was contracted before, otherwise every level is
+   * contracted on the way down and dropped on the way up */
+  std::shared_ptr<Contraction<Graph>> contraction;
+  if (hierarchy != nullptr) {
+    if (level < hierarchy->size()) {
+      contraction = hierarchy->at(level);
+    }
+  } else if (graph.weight_of_nodes->size() > config.contraction_limit) {
+    contraction = contract(graph, config, level, blocks);
+    if (!shrinksEnough(graph, *contraction, config)) {
+      contraction.reset();
+    }
+  }
+
+  if (contraction) {
+    /* a cluster lies in one block, it takes the block along */
+    std::vector<int> coarse_blocks;
+    if (blocks != nullptr) {
+      coarse_blocks.assign(contraction->clusters.size(), 0);
+      for (size_t c = 0; c < contraction->clusters.size(); c++) {
+        if (!contraction->clusters[c].empty()) {
+          coarse_blocks[c] = blocks->at(contraction->clusters[c].front());
+        }
+      }
+    }
+
+    GainCache<Graph> coarse_gains;
+    std::map<IndexType, int> result = Multilevel(
+        *contraction->graph, config, level + 1, hierarchy,
+        sequential ? &coarse_gains : nullptr,
+        blocks != nullptr ? &coarse_blocks : nullptr);
+
+    /* the coarse level is finished, drop it before refining this one */
+    if (hierarchy == nullptr && memory.overCap()) {
+      std::cout << "memory cap: releasing coarse level " << level + 1
+                << std::endl;
+      contraction->graph.reset();
+    }
 
     for (auto n : result) {
-      std::vector<Index> nodes = node_to_nodes_map[n.first];
+      std::vector<IndexType> &nodes = contraction->clusters[n.first];
       if (n.second == 1) {
         part_1.insert(nodes.begin(), nodes.end());
       } else if (n.second == 2) {
         part_2.insert(nodes.begin(), nodes.end());
       }
     }
-    FM(part_1, part_2, graph, ratio, 2);
-  } else {
-    /* initial partitioning stage */
 
-    std::vector<Index> unique_counter;
-    std::vector<Index> sorted_edge = getEdgeByOrderWeight();
-    std::set<Index> node_used_checker;
-    for (auto iter = sorted_edge.begin(); iter != sorted_edge.end(); iter++) {
-      std::vector<Index> nodes = graph.bitMatrix[*iter].toVector();
-      for (auto n : nodes) {
-        if (node_used_checker.find(n) == node_used_checker.end()) {
-          node_used_checker.insert(n);
-          unique_counter.push_back(n);
-        }
+    TRACE_SCOPE(refinement_span, "refinement");
+    TRACE_ARG(refinement_span, "level", level);
+    if (sequential) {
+      level_gains.project(graph, *contraction, coarse_gains);
+      FM<Graph>(part_1, part_2, graph, ratio, config.refinement_passes,
+                level_gains);
+    } else {
+      ParallelFM<Graph>(part_1, part_2, graph, ratio, config.threads,
+                        config.refinement_passes, config.seed);
+    }
+  } else if (blocks != nullptr) {
+    /* the partition the cycle started from, the bottom of a V-cycle is
+     * refined like any other level */
+    TRACE_SCOPE(refinement_span, "refinement");
+    TRACE_ARG(refinement_span, "level", level);
+    for (IndexType n = 0; n < blocks->size(); n++) {
+      if (blocks->at(n) == 1) {
+        part_1.insert(n);
+      } else if (blocks->at(n) == 2) {
+        part_2.insert(n);
       }
     }
-
-    size_t total_area = 0;
-    for (auto i = 0; i < graph.weight_of_nodes->size(); i++) {
-      total_area += graph.weight_of_nodes->at(i);
+    if (sequential) {
+      level_gains.initialize(graph, part_1, part_2);
+      FM<Graph>(part_1, part_2, graph, ratio, config.refinement_passes,
+                level_gains);
+    } else {
+      ParallelFM<Graph>(part_1, part_2, graph, ratio, config.threads,
+                        config.refinement_passes, config.seed);
     }
+  } else {
+    /* initial partitioning stage */
+    TRACE_SCOPE(initial_span, "initial partitioning");
+    TRACE_ARG(initial_span, "level", level);
 
-    size_t part_1_area = 0;
-    size_t part_2_area = 0;
-
-    for (auto iter = unique_counter.begin(); iter != unique_counter.end();
-         iter++) {
-      if (part_1_area < total_area * ratio) {
-        part_1.insert(*iter);
-        part_1_area += graph.weight_of_nodes->at(*iter);
-      } else {
-        part_2.insert(*iter);
-        part_2_area += graph.weight_of_nodes->at(*iter);
-      }
+    std::vector<IndexType> sorted_edge = edgesByOrderWeight(graph);
+    /* with more threads every task starts filling at another net, the
+     * bisection with the smallest cut is kept */
+    size_t candidates = std::max<size_t>(
+        1, std::min<size_t>(config.threads, sorted_edge.size()));
+    size_t first = sorted_edge.empty() ? 0 : config.seed % sorted_edge.size();
+    if (candidates == 1) {
+      initialPartition(graph, ratio, sorted_edge, first, part_1, part_2,
+                       level_gains);
+    } else {
+      std::vector<std::set<IndexType>> parts_1(candidates);
+      std::vector<std::set<IndexType>> parts_2(candidates);
+      std::vector<size_t> cuts(candidates);
+      parallelRun(candidates, [&](size_t c) {
+        GainCache<Graph> gains;
+        initialPartition(graph, ratio, sorted_edge,
+                         first + c * sorted_edge.size() / candidates,
+                         parts_1[c], parts_2[c], gains);
+        std::map<IndexType, int> blocks;
+        for (auto n : parts_1[c]) {
+          blocks.insert(std::pair<IndexType, int>(n, 1));
+        }
+        for (auto n : parts_2[c]) {
+          blocks.insert(std::pair<IndexType, int>(n, 2));
+        }
+        cuts[c] = cutSize(graph, blocks);
+      });
+      size_t best = std::min_element(cuts.begin(), cuts.end()) - cuts.begin();
+      std::cout << "initial partitioning: best of " << candidates
+                << " starts, cut " << cuts[best] << std::endl;
+      part_1.swap(parts_1[best]);
+      part_2.swap(parts_2[best]);
     }
-
-    FM(part_1, part_2, graph, ratio, 10);
   }
 
-  size_t total_cut = 0;
-  bitmap part_1_map;
-  bitmap part_2_map;
-  std::map<Index, int> result;
+  std::map<IndexType, int> result;
   for (auto n : part_1) {
-    result.insert(std::pair<Index, int>(n, 1));
-    part_1_map.set(n);
+    result.insert(std::pair<IndexType, int>(n, 1));
   }
   for (auto n : part_2) {
-    result.insert(std::pair<Index, int>(n, 2));
-    part_2_map.set(n);
+    result.insert(std::pair<IndexType, int>(n, 2));
   }
+  size_t total_cut = cutSize(graph, result);
+  std::cout << "total_cut: " << total_cut << std::endl;
+  TRACE_ARG(level_span, "cut", total_cut);
+
+  partition_memory.update((part_1.size() + part_2.size()) *
+                              (sizeof(IndexType) + TREE_NODE_OVERHEAD) +
+                          result.size() * (sizeof(std::pair<IndexType, int>) +
+                                           TREE_NODE_OVERHEAD));
+  std::ostringstream label;
+  label << "level " << level << " (" << graph.weight_of_nodes->size()
+        << " nodes)";
+  memory.report(std::cout, label.str());
 
-  for (auto e : graph.bitMatrix) {
-    if (!e.logicaland(part_1_map).empty() &&
-        !e.logicaland(part_2_map).empty()) {
-      total_cut++;
+  return result;
+}
+
+template <typename Graph>
+std::map<typename Graph::index_type, int>
+Partition::VCycles(Graph &graph, const MultilevelConfig &config,
+                   const Hierarchy<Graph> *hierarchy) {
+  std::map<typename Graph::index_type, int> result =
+      Multilevel(graph, config, 0, hierarchy);
+  size_t cut = cutSize(graph, result);
+  for (int cycle = 1; cycle <= config.vcycles; cycle++) {
+    TRACE_SCOPE(cycle_span, "v-cycle");
+    TRACE_ARG(cycle_span, "cycle", cycle);
+    std::vector<int> blocks(graph.weight_of_nodes->size(), 0);
+    for (auto n : result) {
+      blocks[n.first] = n.second;
     }
-  }
-  std::cout << "total_cut: " << total_cut << std::endl;
 
+    std::map<typename Graph::index_type, int> next =
+        Multilevel<Graph>(graph, config, 0, nullptr, nullptr, &blocks);
+    size_t next_cut = cutSize(graph, next);
+    std::cout << "v-cycle " << cycle << ": cut " << cut << " -> " << next_cut
+              << std::endl;
+    TRACE_ARG(cycle_span, "cut", next_cut);
+    if (next_cut >= cut) {
+      break;
+    }
+    result.swap(next);
+    cut = next_cut;
+  }
   return result;
 }
+
+template std::shared_ptr<Contraction<HyperGraph32>>
+Partition::contract<HyperGraph32>(const HyperGraph32 &graph,
+                                  const MultilevelConfig &config,
+                                  size_t level, const std::vector<int> *blocks);
+template std::shared_ptr<Contraction<HyperGraph64>>
+Partition::contract<HyperGraph64>(const HyperGraph64 &graph,
+                                  const MultilevelConfig &config,
+                                  size_t level, const std::vector<int> *blocks);
+template Hierarchy<HyperGraph32>
+Partition::coarsen<HyperGraph32>(const HyperGraph32 &graph,
+                                 const MultilevelConfig &config);
+template Hierarchy<HyperGraph64>
+Partition::coarsen<HyperGraph64>(const HyperGraph64 &graph,
+                                 const MultilevelConfig &config);
+template size_t
+Partition::cutSize<HyperGraph32>(const HyperGraph32 &graph,
+                                 const std::map<uint32_t, int> &blocks);
+template size_t
+Partition::cutSize<HyperGraph64>(const HyperGraph64 &graph,
+                                 const std::map<uint64_t, int> &blocks);
+template std::map<uint32_t, int>
+Partition::Multilevel<HyperGraph32>(HyperGraph32 &graph,
+                                    const MultilevelConfig &config,
+                                    size_t level,
+                                    const Hierarchy<HyperGraph32> *hierarchy,
+                                    GainCache<HyperGraph32> *gains,
+                                    const std::vector<int> *blocks);
+template std::map<uint32_t, int>
+Partition::VCycles<HyperGraph32>(HyperGraph32 &graph,
+                                 const MultilevelConfig &config,
+                                 const Hierarchy<HyperGraph32> *hierarchy);
+template std::map<uint64_t, int>
+Partition::Multilevel<HyperGraph64>(HyperGraph64 &graph,
+                                    const MultilevelConfig &config,
+                                    size_t level,
+                                    const Hierarchy<HyperGraph64> *hierarchy,
+                                    GainCache<HyperGraph64> *gains,
+                                    const std::vector<int> *blocks);
+template std::map<uint64_t, int>
+Partition::VCycles<HyperGraph64>(HyperGraph64 &graph,
+                                 const MultilevelConfig &config,
+                                 const Hierarchy<HyperGraph64> *hierarchy);
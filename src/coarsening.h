@@ -1,8 +1,88 @@
 #pragma once
 
 #include "definition.h"
+#include <memory>
 namespace Partition {
 
-std::map<Index, int> Multilevel(HyperGraph &graph, float ratio,
-                                size_t minimum_size);
+struct MultilevelConfig {
+  float ratio = 0.5;
+  /* coarsening stops at this many nodes */
+  size_t contraction_limit = 8;
+  /* a cluster is closed once it has this many nodes */
+  size_t cluster_size = 8;
+  /* or once it weighs this much, 0 means no limit */
+  size_t max_cluster_weight = 0;
+  /* coarsening also stops when a level removes less than this fraction of
+   * the nodes, such a level is thrown away */
+  float min_shrink = 0.05;
+  /* tasks every parallel phase is split into on the thread pool, 1 keeps
+   * the sequential FM with its gain cache */
+  size_t threads = 1;
+  /* number the nodes for locality: RCM order after loading, clusters by
+   * their smallest member after every contraction */
+  bool reorder = false;
+  /* FM passes on every level while uncoarsening */
+  int refinement_passes = 2;
+  /* picks the net the initial partitioning starts from and seeds the order
+   * of the localized searches of the parallel FM */
+  unsigned seed = 0;
+  /* V-cycles after the first one, they stop early once one does not
+   * improve the cut */
+  int vcycles = 0;
+};
+
+template <typename Graph> class GainCache;
+
+/* one level of coarsening: the coarse graph and for every coarse node the
+ * nodes of the finer level it was made of */
+template <typename Graph> struct Contraction {
+  using IndexType = typename Graph::index_type;
+  static const IndexType NO_NET = static_cast<IndexType>(-1);
+
+  std::unique_ptr<Graph> graph;
+  std::vector<std::vector<IndexType>> clusters;
+  /* net of bitMatrix -> the net of the coarse bitMatrix it was merged into,
+   * NO_NET if it became a 2-pin net or lies inside one cluster */
+  std::vector<IndexType> coarse_net;
+};
+
+/* all contractions below a graph, finest first. It does not depend on the
+ * ratio, so a graph partitioned again and again is coarsened only once. */
+template <typename Graph>
+using Hierarchy = std::vector<std::shared_ptr<Contraction<Graph>>>;
+
+/* with blocks (1, 2 or 0 for none) given for every node, only nodes of the
+ * same block are put into one cluster */
+template <typename Graph>
+std::shared_ptr<Contraction<Graph>>
+contract(const Graph &graph, const MultilevelConfig &config, size_t level,
+         const std::vector<int> *blocks = nullptr);
+
+template <typename Graph>
+Hierarchy<Graph> coarsen(const Graph &graph, const MultilevelConfig &config);
+
+/* nets with pins in both blocks, blocks as returned by Multilevel */
+template <typename Graph>
+size_t cutSize(const Graph &graph,
+               const std::map<typename Graph::index_type, int> &blocks);
+
+/* without a hierarchy every level is contracted on the way down, gains gets
+ * the gain cache of the final partition of this level. With blocks of a
+ * previous partition (as for contract) this is a V-cycle: the levels are
+ * contracted inside the blocks and the coarsest one starts from them
+ * instead of a new initial partition, so the cut never gets worse on the
+ * way down. */
+template <typename Graph>
+std::map<typename Graph::index_type, int>
+Multilevel(Graph &graph, const MultilevelConfig &config, size_t level = 0,
+           const Hierarchy<Graph> *hierarchy = nullptr,
+           GainCache<Graph> *gains = nullptr,
+           const std::vector<int> *blocks = nullptr);
+
+/* Multilevel followed by up to config.vcycles V-cycles on its result, the
+ * hierarchy is only used by the first cycle */
+template <typename Graph>
+std::map<typename Graph::index_type, int>
+VCycles(Graph &graph, const MultilevelConfig &config,
+        const Hierarchy<Graph> *hierarchy = nullptr);
 }; // namespace Partition
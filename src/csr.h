@@ -0,0 +1,153 @@
+#pragma once
+
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Partition {
+
+/* compressed rows: row i is entries[offsets[i]] .. entries[offsets[i + 1]] */
+template <typename IndexType> class CSR {
+public:
+  std::vector<IndexType> offsets;
+  std::vector<IndexType> entries;
+
+public:
+  size_t rows() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  size_t rowSize(size_t row) const {
+    return offsets[row + 1] - offsets[row];
+  }
+
+  size_t memoryUsage() const {
+    return (offsets.capacity() + entries.capacity()) * sizeof(IndexType);
+  }
+};
+
+/* inclusive prefix sum in place: every thread scans its own chunk, the chunk
+ * totals are scanned serially and added back in parallel */
+template <typename T>
+void parallelPrefixSum(std::vector<T> &values, size_t threads) {
+  size_t n = values.size();
+  threads = std::max<size_t>(1, std::min(threads, n / 1024));
+  size_t chunk = (n + threads - 1) / threads;
+  std::vector<T> sums(threads, 0);
+
+  parallelRun(threads, [&](size_t t) {
+    size_t from = std::min(n, t * chunk);
+    size_t to = std::min(n, from + chunk);
+    for (size_t i = from + 1; i < to; i++) {
+      values[i] += values[i - 1];
+    }
+    if (from < to) {
+      sums[t] = values[to - 1];
+    }
+  });
+  for (size_t t = 1; t < threads; t++) {
+    sums[t] += sums[t - 1];
+  }
+  parallelRun(threads, [&](size_t t) {
+    size_t from = std::min(n, t * chunk);
+    size_t to = std::min(n, from + chunk);
+    for (size_t i = from; t > 0 && i < to; i++) {
+      values[i] += sums[t - 1];
+    }
+  });
+}
+
+/* edge -> pins from the flat arrays of the parser, edges_index holds where
+ * every edge starts in pins. The pins of an edge come out sorted and without
+ * duplicates, which is what the bitmaps need. */
+template <typename IndexType, typename SourceIndex>
+CSR<IndexType> buildEdgeCSR(const std::vector<SourceIndex> &edges_index,
+                            const std::vector<SourceIndex> &pins,
+                            size_t threads) {
+  size_t edges_count = edges_index.size();
+  /* a trailing end marker is not an edge */
+  if (edges_count > 0 && edges_index[edges_count - 1] == pins.size()) {
+    edges_count--;
+  }
+  auto endOf = [&](size_t e) -> size_t {
+    return e + 1 < edges_index.size() ? edges_index[e + 1] : pins.size();
+  };
+
+  std::vector<IndexType> buffer(pins.size());
+  std::vector<IndexType> counts(edges_count + 1, 0);
+  parallelFor(0, edges_count, threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      std::copy(pins.begin() + edges_index[e], pins.begin() + endOf(e),
+                buffer.begin() + edges_index[e]);
+      std::sort(buffer.begin() + edges_index[e], buffer.begin() + endOf(e));
+      auto first = buffer.begin() + edges_index[e];
+      counts[e + 1] = std::unique(first, buffer.begin() + endOf(e)) - first;
+    }
+  });
+
+  CSR<IndexType> csr;
+  parallelPrefixSum(counts, threads);
+  csr.offsets.swap(counts);
+  csr.entries.resize(csr.offsets[edges_count]);
+  parallelFor(0, edges_count, threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      std::copy(buffer.begin() + edges_index[e],
+                buffer.begin() + edges_index[e] + csr.rowSize(e),
+                csr.entries.begin() + csr.offsets[e]);
+    }
+  });
+  return csr;
+}
+
+/* column -> rows by a counting sort: the row sizes are counted with atomics,
+ * turned into offsets by a prefix sum and every row is scattered into its
+ * slots. Rows are sorted afterwards so the result does not depend on the
+ * scheduling of the threads. */
+template <typename IndexType>
+CSR<IndexType> transpose(const CSR<IndexType> &csr, size_t columns,
+                         size_t threads) {
+  std::unique_ptr<std::atomic<IndexType>[]> position(
+      new std::atomic<IndexType>[columns + 1]);
+  parallelFor(0, columns + 1, threads, [&](size_t from, size_t to) {
+    for (size_t c = from; c < to; c++) {
+      position[c] = 0;
+    }
+  });
+  parallelFor(0, csr.rows(), threads, [&](size_t from, size_t to) {
+    for (size_t i = csr.offsets[from]; i < csr.offsets[to]; i++) {
+      position[csr.entries[i] + 1]++;
+    }
+  });
+
+  CSR<IndexType> result;
+  result.offsets.resize(columns + 1);
+  parallelFor(0, columns + 1, threads, [&](size_t from, size_t to) {
+    for (size_t c = from; c < to; c++) {
+      result.offsets[c] = position[c];
+    }
+  });
+  parallelPrefixSum(result.offsets, threads);
+  parallelFor(0, columns, threads, [&](size_t from, size_t to) {
+    for (size_t c = from; c < to; c++) {
+      position[c] = result.offsets[c];
+    }
+  });
+
+  result.entries.resize(csr.entries.size());
+  parallelFor(0, csr.rows(), threads, [&](size_t from, size_t to) {
+    for (size_t row = from; row < to; row++) {
+      for (size_t i = csr.offsets[row]; i < csr.offsets[row + 1]; i++) {
+        result.entries[position[csr.entries[i]]++] = row;
+      }
+    }
+  });
+  parallelFor(0, columns, threads, [&](size_t from, size_t to) {
+    for (size_t c = from; c < to; c++) {
+      std::sort(result.entries.begin() + result.offsets[c],
+                result.entries.begin() + result.offsets[c + 1]);
+    }
+  });
+  return result;
+}
+
+}; // namespace Partition
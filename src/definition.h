@@ -1,11 +1,14 @@
 #pragma once
 
+#include "csr.h"
 #include "ewah/ewah.h"
+#include "parallel.h"
 #include <algorithm>
 #include <assert.h>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <set>
 #include <vector>
@@ -15,60 +18,253 @@ namespace Partition {
 using Index = std::size_t;
 using bitmap = ewah::EWAHBoolArray<uint64_t>;
 
-class HyperGraph {
+/* 2-pin nets are kept out of the bitmap matrix: the net list itself plus a
+ * weighted adjacency in CSR form (node -> neighbors through a 2-pin net) */
+template <typename IndexType, typename WeightType> class TwoPinNets {
 public:
+  std::vector<std::pair<IndexType, IndexType>> edges;
+  std::vector<WeightType> weights;
+  std::vector<IndexType> offsets;
+  std::vector<IndexType> neighbors;
+  std::vector<WeightType> neighbor_weights;
+
+public:
+  void add(IndexType u, IndexType v, WeightType weight) {
+    assert(u != v);
+    if (u > v) {
+      std::swap(u, v);
+    }
+    edges.push_back(std::pair<IndexType, IndexType>(u, v));
+    weights.push_back(weight);
+  }
+
+  /* counting sort of both directions of every net into the adjacency */
+  void build(size_t nodes_count) {
+    offsets.assign(nodes_count + 1, 0);
+    for (auto &e : edges) {
+      offsets[e.first + 1]++;
+      offsets[e.second + 1]++;
+    }
+    for (size_t i = 0; i < nodes_count; i++) {
+      offsets[i + 1] += offsets[i];
+    }
+
+    std::vector<IndexType> position(offsets.begin(), offsets.end() - 1);
+    neighbors.resize(edges.size() * 2);
+    neighbor_weights.resize(edges.size() * 2);
+    for (size_t i = 0; i < edges.size(); i++) {
+      IndexType u = edges[i].first;
+      IndexType v = edges[i].second;
+      neighbors[position[u]] = v;
+      neighbor_weights[position[u]++] = weights[i];
+      neighbors[position[v]] = u;
+      neighbor_weights[position[v]++] = weights[i];
+    }
+  }
+
+  size_t size() const { return edges.size(); }
+
+  size_t memoryUsage() const {
+    return edges.capacity() * sizeof(std::pair<IndexType, IndexType>) +
+           (offsets.capacity() + neighbors.capacity()) * sizeof(IndexType) +
+           (weights.capacity() + neighbor_weights.capacity()) *
+               sizeof(WeightType);
+  }
+};
+
+/* IndexType is used for node ids, pins and everything keyed by them, WeightType
+ * for node/edge weights and gains. Both are fixed at compile time, the 32-bit
+ * and 64-bit variants are instantiated below and picked at load time. */
+template <typename IndexType, typename WeightType> class BasicHyperGraph {
+public:
+  using index_type = IndexType;
+  using weight_type = WeightType;
+
+public:
+  /* nets with more than two pins, weight_of_edges is indexed the same way */
   std::vector<bitmap> bitMatrix;
-  std::vector<int> *weight_of_edges;
-  std::vector<int> *weight_of_nodes;
+  std::vector<WeightType> *weight_of_edges;
+  std::vector<WeightType> *weight_of_nodes;
+  TwoPinNets<IndexType, WeightType> twoPinNets;
+  /* net of bitMatrix -> its sorted pins, faster to walk than the bitmap */
+  CSR<IndexType> pins;
+  /* node -> nets of bitMatrix */
+  CSR<IndexType> incidence;
+  /* block a node is fixed to (1 or 2, 0 for a free node), empty when no node
+   * is fixed */
+  std::vector<int> fixed;
+
+private:
+  /* splits the nets (rows with sorted, distinct pins) into the bitmap matrix
+   * with its rows and the 2-pin store and builds the node -> net view, the
+   * bitmaps of different nets are filled by different threads */
+  void build(const CSR<IndexType> &nets, const std::vector<WeightType> &w_edges,
+             size_t threads) {
+    size_t edges_count = nets.rows();
+    std::vector<IndexType> hyper_position(edges_count + 1, 0);
+    std::vector<IndexType> two_pin_position(edges_count + 1, 0);
+    parallelFor(0, edges_count, threads, [&](size_t from, size_t to) {
+      for (size_t e = from; e < to; e++) {
+        bool two_pin = nets.rowSize(e) == 2;
+        hyper_position[e + 1] = two_pin ? 0 : 1;
+        two_pin_position[e + 1] = two_pin ? 1 : 0;
+      }
+    });
+    parallelPrefixSum(hyper_position, threads);
+    parallelPrefixSum(two_pin_position, threads);
+
+    CSR<IndexType> &hyper = pins;
+    hyper.offsets.assign(hyper_position[edges_count] + 1, 0);
+    parallelFor(0, edges_count, threads, [&](size_t from, size_t to) {
+      for (size_t e = from; e < to; e++) {
+        if (nets.rowSize(e) != 2) {
+          hyper.offsets[hyper_position[e] + 1] = nets.rowSize(e);
+        }
+      }
+    });
+    parallelPrefixSum(hyper.offsets, threads);
+    hyper.entries.resize(hyper.offsets.back());
+
+    bitMatrix.resize(hyper.rows());
+    weight_of_edges = new std::vector<WeightType>(hyper.rows());
+    twoPinNets.edges.resize(two_pin_position[edges_count]);
+    twoPinNets.weights.resize(two_pin_position[edges_count]);
+    parallelFor(0, edges_count, threads, [&](size_t from, size_t to) {
+      for (size_t e = from; e < to; e++) {
+        auto first = nets.entries.begin() + nets.offsets[e];
+        auto last = nets.entries.begin() + nets.offsets[e + 1];
+        if (nets.rowSize(e) == 2) {
+          twoPinNets.edges[two_pin_position[e]] =
+              std::pair<IndexType, IndexType>(first[0], first[1]);
+          twoPinNets.weights[two_pin_position[e]] = w_edges[e];
+          continue;
+        }
+        IndexType h = hyper_position[e];
+        std::copy(first, last, hyper.entries.begin() + hyper.offsets[h]);
+        for (auto pin = first; pin != last; pin++) {
+          bitMatrix[h].set(*pin);
+        }
+        (*weight_of_edges)[h] = w_edges[e];
+      }
+    });
+#if DEBUG
+    debugInfo();
+#endif
+
+    twoPinNets.build(weight_of_nodes->size());
+    incidence = transpose(hyper, weight_of_nodes->size(), threads);
+  }
 
 public:
-  HyperGraph(std::vector<Index> &edges_index, std::vector<Index> &node_index) {
+  BasicHyperGraph(std::vector<Index> &edges_index,
+                  std::vector<Index> &node_index, size_t threads = 1) {
     assert(edges_index.size() > 0);
     assert(node_index.size() > 0);
     /* this function will be called when we parsing the data file */
     /* so all elements have only weight one */
-    weight_of_edges = new std::vector<int>();
     auto max = std::max_element(node_index.begin(), node_index.end());
-    weight_of_nodes = new std::vector<int>(*max + 1, 1);
+    weight_of_nodes = new std::vector<WeightType>(*max + 1, 1);
+
+    CSR<IndexType> nets =
+        buildEdgeCSR<IndexType>(edges_index, node_index, threads);
+    std::vector<WeightType> w_edges(nets.rows(), 1);
+    build(nets, w_edges, threads);
+  }
+
+  /* nets given as rows of pins, used for the coarse levels */
+  BasicHyperGraph(const CSR<IndexType> &nets, std::vector<WeightType> &w_edges,
+                  std::vector<WeightType> &w_nodes, size_t threads = 1) {
+    assert(nets.rows() == w_edges.size());
+    weight_of_nodes =
+        new std::vector<WeightType>(w_nodes.begin(), w_nodes.end());
+    build(nets, w_edges, threads);
+  }
+
+  /* the weight vectors are owned, so only moving is allowed */
+  BasicHyperGraph(const BasicHyperGraph &) = delete;
+  BasicHyperGraph &operator=(const BasicHyperGraph &) = delete;
+  BasicHyperGraph(BasicHyperGraph &&other)
+      : bitMatrix(std::move(other.bitMatrix)),
+        weight_of_edges(other.weight_of_edges),
+        weight_of_nodes(other.weight_of_nodes),
+        twoPinNets(std::move(other.twoPinNets)), pins(std::move(other.pins)),
+        incidence(std::move(other.incidence)), fixed(std::move(other.fixed)) {
+    other.weight_of_edges = nullptr;
+    other.weight_of_nodes = nullptr;
+  }
+
+  /* edges are numbered over both stores: the nets of bitMatrix first, then the
+   * 2-pin nets */
+  size_t edgeCount() const { return bitMatrix.size() + twoPinNets.size(); }
+
+  bool isTwoPinEdge(size_t edge) const { return edge >= bitMatrix.size(); }
+
+  bool isFixed(size_t node) const { return !fixed.empty() && fixed[node] != 0; }
 
-    if (edges_index[edges_index.size() - 1] < node_index.size()) {
-      edges_index.push_back(node_index.size());
+  std::vector<size_t> pinsOfEdge(size_t edge) const {
+    if (isTwoPinEdge(edge)) {
+      auto &e = twoPinNets.edges[edge - bitMatrix.size()];
+      return std::vector<size_t>({e.first, e.second});
     }
+    return std::vector<size_t>(pins.entries.begin() + pins.offsets[edge],
+                               pins.entries.begin() + pins.offsets[edge + 1]);
+  }
 
-    for (auto i = 0; i < edges_index.size() - 1; i++) {
-      bitmap bitLine;
-      for (auto n = edges_index[i]; n < edges_index[i + 1]; n++) {
-        bitLine.set(node_index[n]);
-      }
-      bitMatrix.push_back(bitLine);
-      weight_of_edges->push_back(1);
-#if DEBUG
-      std::cout << "edge: " << i << "nodes: " << bitLine << std::endl;
-#endif
+  size_t pinCountOfEdge(size_t edge) const {
+    return isTwoPinEdge(edge) ? 2 : pins.rowSize(edge);
+  }
+
+  WeightType weightOfEdge(size_t edge) const {
+    return isTwoPinEdge(edge) ? twoPinNets.weights[edge - bitMatrix.size()]
+                              : weight_of_edges->at(edge);
+  }
+
+  WeightType totalEdgeWeight() const {
+    WeightType total = 0;
+    for (auto w : *weight_of_edges) {
+      total += w;
+    }
+    for (auto w : twoPinNets.weights) {
+      total += w;
     }
+    return total;
   }
 
-  HyperGraph(std::vector<bitmap> &graph_info, std::vector<int> &w_edges,
-             std::vector<int> &w_nodes) {
-    assert(graph_info.size() == w_edges.size());
-    bitmap counter;
-    for (auto i : graph_info) {
-      bitMatrix.push_back(i);
-      counter = counter | i;
-#if DEBUG
-      std::cout << "edge: " << bitMatrix.size() - 1 << "nodes: " << i
-                << std::endl;
-#endif
+  /* sum of the weights of the nets of the heaviest node, no gain can leave
+   * [-maxWeightedDegree(), maxWeightedDegree()] */
+  WeightType maxWeightedDegree() const {
+    WeightType result = 0;
+    for (size_t n = 0; n < weight_of_nodes->size(); n++) {
+      WeightType degree = 0;
+      for (auto i = incidence.offsets[n]; i < incidence.offsets[n + 1]; i++) {
+        degree += weight_of_edges->at(incidence.entries[i]);
+      }
+      for (auto i = twoPinNets.offsets[n]; i < twoPinNets.offsets[n + 1];
+           i++) {
+        degree += twoPinNets.neighbor_weights[i];
+      }
+      result = std::max(result, degree);
     }
-    // assert(counter.numberOfOnes() == w_nodes.size());
+    return result;
+  }
 
-    weight_of_nodes = new std::vector<int>(w_nodes.begin(), w_nodes.end());
-    weight_of_edges = new std::vector<int>(w_edges.begin(), w_edges.end());
+  /* estimated bytes held by the graph */
+  size_t memoryUsage() const {
+    size_t bytes = bitMatrix.capacity() * sizeof(bitmap);
+    for (auto &b : bitMatrix) {
+      bytes += b.sizeInBytes();
+    }
+    bytes += (weight_of_edges->capacity() + weight_of_nodes->capacity()) *
+             sizeof(WeightType);
+    bytes += fixed.capacity() * sizeof(int);
+    return bytes + twoPinNets.memoryUsage() + pins.memoryUsage() +
+           incidence.memoryUsage();
   }
 
-  std::map<Index, bitmap> getEdgesBitmapAmongNodes(std::vector<Index> &nodes) {
+  std::map<IndexType, bitmap>
+  getEdgesBitmapAmongNodes(std::vector<IndexType> &nodes) {
     bitmap comp;
-    std::map<Index, bitmap> result;
+    std::map<IndexType, bitmap> result;
 
     std::sort(nodes.begin(), nodes.end());
     for (auto n : nodes) {
@@ -77,7 +273,7 @@ public:
 
     for (auto i = 0; i < bitMatrix.size(); i++) {
       if (comp.logicalandcount(bitMatrix[i]) > 1) {
-        result.insert(std::pair<Index, bitmap>(i, bitMatrix[i]));
+        result.insert(std::pair<IndexType, bitmap>(i, bitMatrix[i]));
       }
     }
 
@@ -89,16 +285,41 @@ public:
     for (auto i = 0; i < bitMatrix.size(); i++) {
       std::cout << "Edge " << i << " nodes: " << bitMatrix[i] << std::endl;
     }
+    for (auto i = 0; i < twoPinNets.size(); i++) {
+      std::cout << "Edge " << bitMatrix.size() + i
+                << " nodes: " << twoPinNets.edges[i].first << ", "
+                << twoPinNets.edges[i].second << std::endl;
+    }
   }
 
-  ~HyperGraph() {
-    weight_of_edges->clear();
-    weight_of_edges->shrink_to_fit();
-    delete weight_of_edges;
-    weight_of_nodes->clear();
-    weight_of_nodes->shrink_to_fit();
-    delete weight_of_nodes;
+  ~BasicHyperGraph() {
+    if (weight_of_edges != nullptr) {
+      weight_of_edges->clear();
+      weight_of_edges->shrink_to_fit();
+      delete weight_of_edges;
+    }
+    if (weight_of_nodes != nullptr) {
+      weight_of_nodes->clear();
+      weight_of_nodes->shrink_to_fit();
+      delete weight_of_nodes;
+    }
   }
 };
 
+using HyperGraph32 = BasicHyperGraph<uint32_t, int32_t>;
+using HyperGraph64 = BasicHyperGraph<uint64_t, int64_t>;
+using HyperGraph = HyperGraph64;
+
+/* the narrow variant is enough when every node id and pin offset fits in 32
+ * bits, the areas (one per node at load time) fit in a signed 32-bit int and
+ * so does the size of the gain range [-total, total] of the bucket sorter */
+inline bool fitsIn32Bits(size_t nodes_count, size_t pins_count,
+                         size_t total_edge_weight) {
+  const size_t max_weight =
+      static_cast<size_t>(std::numeric_limits<int32_t>::max());
+  return nodes_count <= max_weight &&
+         pins_count < std::numeric_limits<uint32_t>::max() &&
+         total_edge_weight <= (max_weight - 1) / 2;
+}
+
 }; // namespace Partition
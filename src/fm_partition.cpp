@@ -1,5 +1,6 @@
 #include "fm_partition.h"
 #include "definition.h"
+#include "trace.h"
 #include <algorithm>
 #include <cstddef>
 #include <iostream>
@@ -9,13 +10,15 @@
 
 namespace Partition {
 
-bool BucketSorter::addValue(Index id, int gain) {
+template <typename IndexType, typename WeightType>
+bool BucketSorter<IndexType, WeightType>::addValue(IndexType id,
+                                                   WeightType gain) {
   assert(gain >= _low && gain <= _high);
   if (_idSet.find(id) != _idSet.end()) {
     return false;
   }
 
-  _idSet.insert(std::pair<Index, int>(id, gain));
+  _idSet.insert(std::pair<IndexType, WeightType>(id, gain));
   (*bucket)[gain - _low]->push_back(id);
   if (gain > _max) {
     _max = gain;
@@ -28,25 +31,30 @@ bool BucketSorter::addValue(Index id, int gain) {
   return true;
 }
 
-bool BucketSorter::updateValue(Index id, int gain) {
+template <typename IndexType, typename WeightType>
+bool BucketSorter<IndexType, WeightType>::updateValue(IndexType id,
+                                                      WeightType gain) {
+  /* a compact range (see FM::initBucketSorter) can be left by the
+   * approximated updates, keep those gains at the edge */
   if (gain < _low) {
     gain = _low;
+  } else if (gain > _high) {
+    gain = _high;
   }
-  assert(gain <= _high);
 
   auto iter = _idSet.find(id);
   if (iter != _idSet.end()) {
     auto link_root = (*bucket)[iter->second - _low];
     link_root->remove(id);
     if (iter->second == _max) {
-      for (int i = _max; i > _min; i--) {
+      for (WeightType i = _max; i > _min; i--) {
         if ((*bucket)[i - _low]->size() != 0) {
           _max = i;
           break;
         }
       }
     } else if (iter->second == _min) {
-      for (int i = _min; i < _max; i++) {
+      for (WeightType i = _min; i < _max; i++) {
         if ((*bucket)[i - _low]->size() != 0) {
           _min = i;
           break;
@@ -56,7 +64,7 @@ bool BucketSorter::updateValue(Index id, int gain) {
     /* update */
     iter->second = gain;
   } else {
-    _idSet.insert(std::pair<Index, int>(id, gain));
+    _idSet.insert(std::pair<IndexType, WeightType>(id, gain));
   }
 
   (*bucket)[gain - _low]->push_back(id);
@@ -71,20 +79,21 @@ bool BucketSorter::updateValue(Index id, int gain) {
   return true;
 }
 
-void BucketSorter::removeValue(Index id) {
+template <typename IndexType, typename WeightType>
+void BucketSorter<IndexType, WeightType>::removeValue(IndexType id) {
   auto iter = _idSet.find(id);
   if (iter != _idSet.end()) {
     (*bucket)[iter->second - _low]->remove(id);
 
     if (iter->second == _max) {
-      for (int i = _max; i > _min; i--) {
+      for (WeightType i = _max; i > _min; i--) {
         if ((*bucket)[i - _low]->size() != 0) {
           _max = i;
           break;
         }
       }
     } else if (iter->second == _min) {
-      for (int i = _min; i < _max; i++) {
+      for (WeightType i = _min; i < _max; i++) {
         if ((*bucket)[i - _low]->size() != 0) {
           _min = i;
           break;
@@ -95,20 +104,22 @@ void BucketSorter::removeValue(Index id) {
   }
 }
 
-void BucketSorter::removeValueWithGain(Index id, int gain) {
+template <typename IndexType, typename WeightType>
+void BucketSorter<IndexType, WeightType>::removeValueWithGain(IndexType id,
+                                                              WeightType gain) {
   assert(gain >= _low && gain <= _high);
 
   bucket->at(gain - _low)->remove(id);
   _idSet.erase(id);
   if (gain == _max) {
-    for (int i = _max; i > _min; i--) {
+    for (WeightType i = _max; i > _min; i--) {
       if ((*bucket)[i - _low]->size() != 0) {
         _max = i;
         break;
       }
     }
   } else if (gain == _min) {
-    for (int i = _min; i < _max; i++) {
+    for (WeightType i = _min; i < _max; i++) {
       if ((*bucket)[i - _low]->size() != 0) {
         _min = i;
         break;
@@ -117,7 +128,8 @@ void BucketSorter::removeValueWithGain(Index id, int gain) {
   }
 }
 
-bool BucketSorter::getMax(Index &index) {
+template <typename IndexType, typename WeightType>
+bool BucketSorter<IndexType, WeightType>::getMax(IndexType &index) {
   if (bucket->at(_max - _low)->size() != 0) {
     index = bucket->at(_max - _low)->front();
     return true;
@@ -126,7 +138,8 @@ bool BucketSorter::getMax(Index &index) {
   return false;
 }
 
-bool BucketSorter::getMin(Index &index) {
+template <typename IndexType, typename WeightType>
+bool BucketSorter<IndexType, WeightType>::getMin(IndexType &index) {
   if (bucket->at(_min - _low)->size() != 0) {
     index = bucket->at(_min - _low)->front();
     return true;
@@ -135,7 +148,8 @@ bool BucketSorter::getMin(Index &index) {
   return false;
 }
 
-int BucketSorter::getGain(Index &index) {
+template <typename IndexType, typename WeightType>
+WeightType BucketSorter<IndexType, WeightType>::getGain(IndexType &index) {
   auto iter = _idSet.find(index);
   if (iter != _idSet.end()) {
     return iter->second;
@@ -143,8 +157,11 @@ int BucketSorter::getGain(Index &index) {
   return 0;
 }
 
-int BucketSorter::incrementGain(Index &index, int value) {
-  int gain = 0;
+template <typename IndexType, typename WeightType>
+WeightType
+BucketSorter<IndexType, WeightType>::incrementGain(IndexType &index,
+                                                   WeightType value) {
+  WeightType gain = 0;
   auto iter = _idSet.find(index);
   if (iter != _idSet.end()) {
     gain = iter->second;
@@ -156,8 +173,11 @@ int BucketSorter::incrementGain(Index &index, int value) {
   return gain;
 }
 
-int BucketSorter::incrementExistGain(Index &index, int value) {
-  int gain = 0;
+template <typename IndexType, typename WeightType>
+WeightType
+BucketSorter<IndexType, WeightType>::incrementExistGain(IndexType &index,
+                                                        WeightType value) {
+  WeightType gain = 0;
   auto iter = _idSet.find(index);
   if (iter != _idSet.end()) {
     gain = iter->second;
@@ -171,13 +191,14 @@ int BucketSorter::incrementExistGain(Index &index, int value) {
   return gain;
 }
 
-bool BucketSorter::getHighAvalible(Index &index,
-                                   std::function<bool(Index)> filter) {
+template <typename IndexType, typename WeightType>
+bool BucketSorter<IndexType, WeightType>::getHighAvalible(
+    IndexType &index, std::function<bool(IndexType)> filter) {
   if (_idSet.size() == 0) {
     return false;
   }
 
-  for (int i = _max - _low; i >= _min - _low; i--) {
+  for (WeightType i = _max - _low; i >= _min - _low; i--) {
     for (auto iter = (*bucket)[i]->begin(); iter != (*bucket)[i]->end();
          iter++) {
       if (filter(*iter)) {
@@ -189,19 +210,29 @@ bool BucketSorter::getHighAvalible(Index &index,
   return false;
 }
 
-int BucketSorter::getAllGain() {
+template <typename IndexType, typename WeightType>
+WeightType BucketSorter<IndexType, WeightType>::getAllGain() {
   if (_idSet.size() == 0) {
     return 0;
   }
 
-  int result = 0;
-  for (int i = _max - _low; i >= _min - _low; i--) {
+  WeightType result = 0;
+  for (WeightType i = _max - _low; i >= _min - _low; i--) {
     result += (*bucket)[i]->size() * (i + _low);
   }
   return result;
 }
 
-void BucketSorter::debugInfo() {
+template <typename IndexType, typename WeightType>
+size_t BucketSorter<IndexType, WeightType>::memoryUsage() {
+  return estimateMemory(_low, _high) +
+         _idSet.size() * (sizeof(std::pair<const IndexType, WeightType>) +
+                          TREE_NODE_OVERHEAD) +
+         _idSet.size() * (sizeof(IndexType) + LIST_NODE_OVERHEAD);
+}
+
+template <typename IndexType, typename WeightType>
+void BucketSorter<IndexType, WeightType>::debugInfo() {
   std::cout << "low: " << _low << " high: " << _high << std::endl;
   std::cout << "Gain range: " << _min << "::" << _max << std::endl;
   std::cout << "{ ";
@@ -216,13 +247,15 @@ void BucketSorter::debugInfo() {
   }
 }
 
-FM::FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
-       float ratio, int k)
-    : ratio(ratio) {
+template <typename Graph>
+FM<Graph>::FM(std::set<IndexType> &part_1, std::set<IndexType> &part_2,
+              Graph &graph, float ratio, int k, GainCache<Graph> &cache)
+    : ratio(ratio), cache(cache) {
   std::cout << "part_1 size: " << part_1.size()
             << "  part_2 size: " << part_2.size() << std::endl;
   auto total_area = std::accumulate(graph.weight_of_nodes->begin(),
-                                    graph.weight_of_nodes->end(), 0);
+                                    graph.weight_of_nodes->end(),
+                                    WeightType(0));
   auto max_area = std::max_element(graph.weight_of_nodes->begin(),
                                    graph.weight_of_nodes->end());
   size_t part_1_area = 0;
@@ -253,7 +286,7 @@ FM::FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
   };
 
   auto highest_gain = [&part_1, condition_checker, &part_1_area, this,
-                       &graph](Index index) -> bool {
+                       &graph](IndexType index) -> bool {
     if (this->locked.find(index) != this->locked.end()) {
       return false;
     }
@@ -266,11 +299,16 @@ FM::FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
     }
   };
 
-  initBucketSorter(part_1, part_2, graph);
+  initBucketSorter(graph);
+  gain_queue_memory.update(sorter->memoryUsage());
   size_t loop_count = 0;
+  size_t pass_moves = 0;
+  TRACE_SCOPE(pass_span, "fm pass");
+  TRACE_ARG(pass_span, "pass", loop_count);
+  TRACE_ARG(pass_span, "nodes", graph.weight_of_nodes->size());
 
   while (true) {
-    Index need_to_move = 0;
+    IndexType need_to_move = 0;
     if (sorter->getHighAvalible(need_to_move, highest_gain)) {
       /* update area infomation */
       size_t need_to_move_area = graph.weight_of_nodes->at(need_to_move);
@@ -286,6 +324,8 @@ FM::FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
         part_2_area -= need_to_move_area;
       }
       locked.insert(need_to_move);
+      pass_moves++;
+      TRACE_ARG(pass_span, "moves", pass_moves);
       // sorter->removeValue(need_to_move);
 
     } else {
@@ -297,94 +337,19 @@ FM::FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
         }
         locked.clear();
         loop_count++;
+        pass_moves = 0;
+        TRACE_NEXT(pass_span);
+        TRACE_ARG(pass_span, "pass", loop_count);
+        TRACE_ARG(pass_span, "moves", pass_moves);
         continue;
       }
       break;
     }
 
-    bitmap part_1_map;
-    bitmap part_2_map;
-
-    for (auto n : part_1) {
-      part_1_map.set(n);
-    }
-    for (auto n : part_2) {
-      part_2_map.set(n);
-    }
-    for (auto iter = graph.bitMatrix.begin(); iter != graph.bitMatrix.end();
-         iter++) {
-      if (iter->get(need_to_move)) {
-        bitmap and_1 = part_1_map.logicaland(*iter);
-        bitmap and_2 = part_2_map.logicaland(*iter);
-
-        size_t edge_weight =
-            graph.weight_of_edges->at(iter - graph.bitMatrix.begin());
-
-        int change = 0;
-        if (iter->numberOfOnes() > 2) {
-          change = 1 * edge_weight;
-        } else {
-          change = 2 * edge_weight;
-        }
-        if (and_1.empty()) {
-          for (auto v : and_2.toArray()) {
-            sorter->incrementExistGain(v, -change);
-          }
-          if (iter->numberOfOnes() > 2) {
-            sorter->incrementExistGain(need_to_move, -change);
-          }
-        } else if (and_2.empty()) {
-          for (auto v : and_1.toArray()) {
-            sorter->incrementExistGain(v, -change);
-          }
-          if (iter->numberOfOnes() > 2) {
-            sorter->incrementExistGain(need_to_move, -change);
-          }
-        } else {
-          if (and_1.get(need_to_move)) {
-            if (and_2.numberOfOnes() == 1) {
-              if (and_1.numberOfOnes() == 2) {
-                for (auto v : and_1.toArray()) {
-                  if (v != need_to_move) {
-                    sorter->incrementExistGain(v, -change);
-                  }
-                }
-              } else {
-                sorter->incrementExistGain(need_to_move, change);
-              }
-              for (auto v : and_2.toArray()) {
-                sorter->incrementExistGain(v, change);
-              }
-            } else if (and_1.numberOfOnes() == 1) {
-              for (auto v : and_2.toArray()) {
-                sorter->incrementExistGain(v, change);
-              }
-              sorter->incrementExistGain(need_to_move, 2 * change);
-            }
-          } else if (and_2.get(need_to_move)) {
-            if (and_1.numberOfOnes() == 1) {
-              for (auto v : and_1.toArray()) {
-                sorter->incrementExistGain(v, change);
-              }
-              if (and_2.numberOfOnes() == 2) {
-                for (auto v : and_2.toArray()) {
-                  if (v != need_to_move) {
-                    sorter->incrementExistGain(v, -change);
-                  }
-                }
-              } else {
-                sorter->incrementExistGain(need_to_move, change);
-              }
-            } else if (and_2.numberOfOnes() == 1) {
-              for (auto v : and_1.toArray()) {
-                sorter->incrementExistGain(v, change);
-              }
-              sorter->incrementExistGain(need_to_move, 2 * change);
-            }
-          }
-        }
-      }
-    }
+    /* exact updates from the pin counts of the cache */
+    cache.move(graph, need_to_move, [this](IndexType n, WeightType delta) {
+      sorter->incrementExistGain(n, delta);
+    });
 #if DEBUG
     sorter->debugInfo();
 #endif
@@ -406,60 +371,38 @@ FM::FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
 #endif
 }
 
-void FM::initBucketSorter(std::set<Index> &part_1, std::set<Index> &part_2,
-                          HyperGraph &graph) {
+template <typename Graph>
+void FM<Graph>::initBucketSorter(Graph &graph) {
 
   /* here we can use a more memory efficient method, but not necessary for the
    * given test set */
-  size_t range = std::accumulate(graph.weight_of_edges->begin(),
-                                 graph.weight_of_edges->end(), 0);
-  sorter = new BucketSorter(-range, range);
-  bitmap part_1_map;
-  bitmap part_2_map;
-  for (auto n : part_1) {
-    part_1_map.set(n);
-  }
-
-  for (auto n : part_2) {
-    part_2_map.set(n);
+  WeightType range = graph.totalEdgeWeight();
+  using Sorter = BucketSorter<IndexType, WeightType>;
+  if (MemoryTracker::instance().overCap(
+          Sorter::estimateMemory(-range, range))) {
+    WeightType compact = graph.maxWeightedDegree();
+    if (compact < range) {
+      std::cout << "memory cap: gain range " << range << " -> " << compact
+                << std::endl;
+      range = compact;
+    }
   }
-
-  for (auto iter = graph.bitMatrix.begin(); iter != graph.bitMatrix.end();
-       iter++) {
-    auto and_1 = iter->logicaland(part_1_map);
-    auto and_2 = iter->logicaland(part_2_map);
-    size_t count_1 = and_1.numberOfOnes();
-    size_t count_2 = and_2.numberOfOnes();
-
-    size_t edge_weight =
-        graph.weight_of_edges->at(iter - graph.bitMatrix.begin());
-
-    if (count_1 == 0) {
-      /* internal connection in part_2 */
-      for (auto n : and_2.toArray()) {
-        sorter->incrementGain(n, -edge_weight);
-      }
-    } else if (count_2 == 0) {
-      for (auto n : and_1.toArray()) {
-        sorter->incrementGain(n, -edge_weight);
-      }
-    } else {
-      if (count_1 == 1) {
-        /* perfect external connection */
-        for (auto n : and_1.toArray()) {
-          sorter->incrementGain(n, edge_weight);
-        }
-      }
-      if (count_2 == 1) {
-        for (auto n : and_2.toArray()) {
-          sorter->incrementGain(n, edge_weight);
-        }
-      }
+  sorter = new Sorter(-range, range);
+  auto &incidence = graph.incidence;
+  auto &two_pin = graph.twoPinNets;
+  /* fixed nodes are never candidates, updates of their gains are ignored */
+  for (IndexType n = 0; n < graph.weight_of_nodes->size(); n++) {
+    bool has_nets = incidence.offsets[n] != incidence.offsets[n + 1] ||
+                    two_pin.offsets[n] != two_pin.offsets[n + 1];
+    if (has_nets && cache.side[n] != cache.NO_SIDE && !graph.isFixed(n)) {
+      sorter->updateValue(n, cache.gain[n]);
     }
-#if DEBUG
-    sorter->debugInfo();
-#endif
   }
 }
 
+template class BucketSorter<uint32_t, int32_t>;
+template class BucketSorter<uint64_t, int64_t>;
+template class FM<HyperGraph32>;
+template class FM<HyperGraph64>;
+
 } // namespace Partition
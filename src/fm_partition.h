@@ -1,4 +1,6 @@
 #include "definition.h"
+#include "gain_cache.h"
+#include "memory.h"
 #include <assert.h>
 #include <cstddef>
 #include <functional>
@@ -9,20 +11,20 @@
 
 namespace Partition {
 
-class BucketSorter {
+template <typename IndexType, typename WeightType> class BucketSorter {
 private:
-  int _low = 0;
-  int _high = 0;
-  int _max = 0;
-  int _min = 0;
-  std::vector<std::list<Index> *> *bucket = nullptr;
-  std::map<Index, int> _idSet;
+  WeightType _low = 0;
+  WeightType _high = 0;
+  WeightType _max = 0;
+  WeightType _min = 0;
+  std::vector<std::list<IndexType> *> *bucket = nullptr;
+  std::map<IndexType, WeightType> _idSet;
 
 public:
-  BucketSorter(int low, int high) : _low(low), _high(high) {
-    bucket = new std::vector<std::list<Index> *>();
-    for (int i = low; i <= high; i++) {
-      std::list<Index> *list = new std::list<Index>();
+  BucketSorter(WeightType low, WeightType high) : _low(low), _high(high) {
+    bucket = new std::vector<std::list<IndexType> *>();
+    for (WeightType i = low; i <= high; i++) {
+      std::list<IndexType> *list = new std::list<IndexType>();
       bucket->push_back(list);
     }
     _max = low;
@@ -37,37 +39,49 @@ public:
     delete bucket;
   }
 
-  bool addValue(Index id, int gain);
-  bool updateValue(Index id, int gain);
-  void removeValue(Index id);
-  void removeValueWithGain(Index id, int gain);
-  bool getMax(Index &index);
-  bool getMin(Index &index);
-  int getGain(Index &index);
-  int incrementGain(Index &index, int value);
-  int incrementExistGain(Index &index, int value);
-  bool getHighAvalible(Index &index, std::function<bool(Index)> filter);
-  int getAllGain();
+  bool addValue(IndexType id, WeightType gain);
+  bool updateValue(IndexType id, WeightType gain);
+  void removeValue(IndexType id);
+  void removeValueWithGain(IndexType id, WeightType gain);
+  bool getMax(IndexType &index);
+  bool getMin(IndexType &index);
+  WeightType getGain(IndexType &index);
+  WeightType incrementGain(IndexType &index, WeightType value);
+  WeightType incrementExistGain(IndexType &index, WeightType value);
+  bool getHighAvalible(IndexType &index,
+                       std::function<bool(IndexType)> filter);
+  WeightType getAllGain();
+  size_t memoryUsage();
   void debugInfo();
+
+  /* what a sorter over [low, high] costs before anything is added */
+  static size_t estimateMemory(WeightType low, WeightType high) {
+    return (high - low + 1) *
+           (sizeof(std::list<IndexType> *) + sizeof(std::list<IndexType>));
+  }
 };
 
-class FM {
+template <typename Graph> class FM {
 private:
+  using IndexType = typename Graph::index_type;
+  using WeightType = typename Graph::weight_type;
+
   float ratio = 0.0;
-  BucketSorter *sorter = nullptr;
-  std::set<Index> locked;
+  BucketSorter<IndexType, WeightType> *sorter = nullptr;
+  std::set<IndexType> locked;
+  MemoryRecord gain_queue_memory{GAIN_QUEUE};
+  GainCache<Graph> &cache;
 
 private:
-  void initBucketSorter(std::set<Index> &part_1, std::set<Index> &part_2,
-                        HyperGraph &graph);
+  void initBucketSorter(Graph &graph);
 
 public:
-  FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
-     float ratio) {
-    FM(part_1, part_2, graph, ratio, 0);
-  };
-  FM(std::set<Index> &part_1, std::set<Index> &part_2, HyperGraph &graph,
-     float ratio, int k);
+  /* the sorter starts from the gains of the cache, which has to be
+   * initialized or projected for part_1 and part_2, and a move updates both
+   * from the pin counts of the cache. Fixed nodes of the graph are kept out
+   * of the sorter. */
+  FM(std::set<IndexType> &part_1, std::set<IndexType> &part_2, Graph &graph,
+     float ratio, int k, GainCache<Graph> &cache);
   ~FM() { delete sorter; };
 };
 
@@ -0,0 +1,217 @@
+#include "gain_cache.h"
+#include <algorithm>
+
+namespace Partition {
+
+template <typename Graph> const uint8_t GainCache<Graph>::NO_SIDE;
+
+template <typename Graph> void GainCache<Graph>::countPins(const Graph &graph) {
+  auto &incidence = graph.incidence;
+  size_t nodes_count = graph.weight_of_nodes->size();
+  pin_count[0].assign(graph.bitMatrix.size(), 0);
+  pin_count[1].assign(graph.bitMatrix.size(), 0);
+  for (size_t n = 0; n < nodes_count; n++) {
+    if (side[n] == NO_SIDE) {
+      continue;
+    }
+    for (auto i = incidence.offsets[n]; i < incidence.offsets[n + 1]; i++) {
+      pin_count[side[n]][incidence.entries[i]]++;
+    }
+  }
+}
+
+template <typename Graph> void GainCache<Graph>::updateMemory() {
+  memory.update(side.capacity() * sizeof(uint8_t) +
+                (pin_count[0].capacity() + pin_count[1].capacity()) *
+                    sizeof(IndexType) +
+                gain.capacity() * sizeof(WeightType));
+}
+
+template <typename Graph>
+void GainCache<Graph>::initialize(const Graph &graph,
+                                  const std::set<IndexType> &part_1,
+                                  const std::set<IndexType> &part_2) {
+  size_t nodes_count = graph.weight_of_nodes->size();
+  side.assign(nodes_count, NO_SIDE);
+  for (auto n : part_1) {
+    side[n] = 0;
+  }
+  for (auto n : part_2) {
+    side[n] = 1;
+  }
+  countPins(graph);
+
+  gain.assign(nodes_count, 0);
+  for (size_t n = 0; n < nodes_count; n++) {
+    gain[n] = computeGain(graph, n);
+  }
+  updateMemory();
+}
+
+template <typename Graph>
+void GainCache<Graph>::project(const Graph &graph,
+                               const Contraction<Graph> &contraction,
+                               const GainCache &coarse) {
+  size_t nodes_count = graph.weight_of_nodes->size();
+  side.assign(nodes_count, NO_SIDE);
+  for (size_t c = 0; c < contraction.clusters.size(); c++) {
+    for (auto n : contraction.clusters[c]) {
+      side[n] = coarse.side[c];
+    }
+  }
+
+  /* a net with one pin in every cluster it touches has the pin counts of the
+   * coarse net it was merged into. Only the nets with more pins in one
+   * cluster, which are 2-pin nets or gone on the coarse level, are counted
+   * again. */
+  auto &pins = graph.pins;
+  size_t edges_count = graph.bitMatrix.size();
+  pin_count[0].resize(edges_count);
+  pin_count[1].resize(edges_count);
+  for (size_t e = 0; e < edges_count; e++) {
+    IndexType coarse_net = contraction.coarse_net[e];
+    if (coarse_net != Contraction<Graph>::NO_NET &&
+        coarse.pin_count[0][coarse_net] + coarse.pin_count[1][coarse_net] ==
+            pins.rowSize(e)) {
+      pin_count[0][e] = coarse.pin_count[0][coarse_net];
+      pin_count[1][e] = coarse.pin_count[1][coarse_net];
+      continue;
+    }
+    pin_count[0][e] = 0;
+    pin_count[1][e] = 0;
+    for (auto p = pins.offsets[e]; p < pins.offsets[e + 1]; p++) {
+      uint8_t s = side[pins.entries[p]];
+      if (s != NO_SIDE) {
+        pin_count[s][e]++;
+      }
+    }
+  }
+
+  /* a node alone in its cluster sees every net it is in on the coarse level
+   * too, with the same pins on each side apart from its own cluster */
+  gain.assign(nodes_count, 0);
+  for (size_t c = 0; c < contraction.clusters.size(); c++) {
+    auto &cluster = contraction.clusters[c];
+    if (cluster.size() == 1) {
+      gain[cluster.front()] = coarse.gain[c];
+      continue;
+    }
+    for (auto n : cluster) {
+      gain[n] = computeGain(graph, n);
+    }
+  }
+  updateMemory();
+}
+
+template <typename Graph>
+typename GainCache<Graph>::WeightType
+GainCache<Graph>::computeGain(const Graph &graph, IndexType node) const {
+  uint8_t from = side[node];
+  if (from == NO_SIDE) {
+    return 0;
+  }
+  uint8_t to = 1 - from;
+
+  auto &incidence = graph.incidence;
+  WeightType result = 0;
+  for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1]; i++) {
+    IndexType e = incidence.entries[i];
+    if (pin_count[from][e] + pin_count[to][e] < 2) {
+      /* a net of one pin is never cut */
+      continue;
+    }
+    WeightType edge_weight = graph.weight_of_edges->at(e);
+    if (pin_count[to][e] == 0) {
+      result -= edge_weight;
+    } else if (pin_count[from][e] == 1) {
+      result += edge_weight;
+    }
+  }
+
+  auto &two_pin = graph.twoPinNets;
+  for (auto i = two_pin.offsets[node]; i < two_pin.offsets[node + 1]; i++) {
+    uint8_t neighbor_side = side[two_pin.neighbors[i]];
+    if (neighbor_side == from) {
+      result -= two_pin.neighbor_weights[i];
+    } else if (neighbor_side == to) {
+      result += two_pin.neighbor_weights[i];
+    }
+  }
+  return result;
+}
+
+/* what a net adds to the gain of a pin with own pins on its side and other
+ * pins on the other side, the same rule as in computeGain */
+template <typename WeightType, typename IndexType>
+static WeightType contribution(WeightType weight, IndexType own,
+                               IndexType other) {
+  if (own + other < 2) {
+    return 0;
+  } else if (other == 0) {
+    return -weight;
+  } else if (own == 1) {
+    return weight;
+  }
+  return 0;
+}
+
+template <typename Graph>
+void GainCache<Graph>::move(
+    const Graph &graph, IndexType node,
+    const std::function<void(IndexType, WeightType)> &changed) {
+  auto &incidence = graph.incidence;
+  uint8_t from = side[node];
+  uint8_t to = 1 - from;
+  WeightType node_delta = 0;
+  for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1]; i++) {
+    IndexType e = incidence.entries[i];
+    WeightType w = graph.weight_of_edges->at(e);
+    IndexType f = pin_count[from][e];
+    IndexType t = pin_count[to][e];
+    pin_count[from][e]--;
+    pin_count[to][e]++;
+
+    node_delta += contribution(w, t + 1, f - 1) - contribution(w, f, t);
+    /* every other pin on the same side changes by the same amount */
+    WeightType delta_from =
+        contribution(w, f - 1, t + 1) - contribution(w, f, t);
+    WeightType delta_to = contribution(w, t + 1, f - 1) - contribution(w, t, f);
+    if (delta_from == 0 && delta_to == 0) {
+      continue;
+    }
+    for (auto p = graph.pins.offsets[e]; p < graph.pins.offsets[e + 1]; p++) {
+      IndexType n = graph.pins.entries[p];
+      if (n == node || side[n] == NO_SIDE) {
+        continue;
+      }
+      WeightType delta = side[n] == from ? delta_from : delta_to;
+      if (delta != 0) {
+        gain[n] += delta;
+        changed(n, delta);
+      }
+    }
+  }
+
+  /* a 2-pin net flips between internal and cut */
+  auto &two_pin = graph.twoPinNets;
+  for (auto i = two_pin.offsets[node]; i < two_pin.offsets[node + 1]; i++) {
+    IndexType neighbor = two_pin.neighbors[i];
+    WeightType change = 2 * two_pin.neighbor_weights[i];
+    if (side[neighbor] == NO_SIDE) {
+      continue;
+    }
+    WeightType delta = side[neighbor] == from ? change : -change;
+    node_delta += delta;
+    gain[neighbor] += delta;
+    changed(neighbor, delta);
+  }
+
+  side[node] = to;
+  gain[node] += node_delta;
+  changed(node, node_delta);
+}
+
+template class GainCache<HyperGraph32>;
+template class GainCache<HyperGraph64>;
+
+} // namespace Partition
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "coarsening.h"
+#include "definition.h"
+#include "memory.h"
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <vector>
+
+namespace Partition {
+
+/* FM gains of every node kept across the levels of the multilevel scheme,
+ * together with the pin counts of the nets of bitMatrix they come from. A
+ * move patches only the pins of the nets of the moved node. Going down a
+ * level the pin counts of a net with one pin in every cluster are those of
+ * its coarse net and the gains of nodes which were not merged with anything
+ * are taken from the coarse level as they are, only the rest is counted and
+ * computed again. */
+template <typename Graph> class GainCache {
+private:
+  using IndexType = typename Graph::index_type;
+  using WeightType = typename Graph::weight_type;
+
+public:
+  /* side of a node which is in neither part (not covered by any net) */
+  static const uint8_t NO_SIDE = 2;
+
+  std::vector<uint8_t> side;
+  std::vector<IndexType> pin_count[2];
+  std::vector<WeightType> gain;
+
+private:
+  MemoryRecord memory{GAIN_QUEUE};
+
+  void countPins(const Graph &graph);
+  void updateMemory();
+
+public:
+  /* everything from scratch */
+  void initialize(const Graph &graph, const std::set<IndexType> &part_1,
+                  const std::set<IndexType> &part_2);
+  /* from the cache of the coarse level, after its partition was projected */
+  void project(const Graph &graph, const Contraction<Graph> &contraction,
+               const GainCache &coarse);
+
+  WeightType computeGain(const Graph &graph, IndexType node) const;
+  /* moves a node to the other part, changed(node, delta) is called for every
+   * gain which changes */
+  void move(const Graph &graph, IndexType node,
+            const std::function<void(IndexType, WeightType)> &changed);
+};
+
+}; // namespace Partition
@@ -0,0 +1,137 @@
+#include "loader.h"
+#include "csr.h"
+#include "reorder.h"
+#include "trace.h"
+#include <algorithm>
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace Partition {
+
+template <typename Graph>
+const Hierarchy<Graph> &
+LoadedGraph<Graph>::getHierarchy(const MultilevelConfig &config) {
+  std::lock_guard<std::mutex> lock(hierarchy_mutex);
+  if (!coarsened) {
+    hierarchy = coarsen(*graph, config);
+    coarsened = true;
+  }
+  return hierarchy;
+}
+
+template <typename Graph>
+std::string LoadedGraph<Graph>::setFixed(
+    const std::vector<std::pair<Index, int>> &nodes) {
+  assert(!coarsened);
+  /* the graph has the nodes up to the largest pin, the header may count
+   * more of them */
+  size_t nodes_count = graph->weight_of_nodes->size();
+  for (auto &n : nodes) {
+    if (n.first >= nodes_count) {
+      std::ostringstream message;
+      message << "fixed node " << n.first << " is out of 0.."
+              << nodes_count - 1;
+      return message.str();
+    }
+  }
+  graph->fixed.assign(nodes_count, 0);
+  for (auto &n : nodes) {
+    graph->fixed[new_id.empty() ? n.first : new_id[n.first]] = n.second;
+  }
+  std::cout << nodes.size() << " fixed nodes" << std::endl;
+  return "";
+}
+
+template <typename Graph>
+std::map<typename Graph::index_type, int> LoadedGraph<Graph>::toInputIds(
+    const std::map<IndexType, int> &blocks) const {
+  if (new_id.empty()) {
+    return blocks;
+  }
+
+  std::vector<IndexType> old_id(new_id.size());
+  for (size_t i = 0; i < new_id.size(); i++) {
+    old_id[new_id[i]] = i;
+  }
+  std::map<IndexType, int> result;
+  for (auto &n : blocks) {
+    result.insert(std::pair<IndexType, int>(old_id[n.first], n.second));
+  }
+  return result;
+}
+
+template <typename Graph> size_t LoadedGraph<Graph>::graphMemory() const {
+  return graph->memoryUsage() + new_id.capacity() * sizeof(IndexType);
+}
+
+template <typename Graph> size_t LoadedGraph<Graph>::hierarchyMemory() {
+  std::lock_guard<std::mutex> lock(hierarchy_mutex);
+  size_t bytes = 0;
+  for (auto &contraction : hierarchy) {
+    bytes += contraction->graph->memoryUsage() +
+             contraction->coarse_net.capacity() * sizeof(IndexType);
+    for (auto &cluster : contraction->clusters) {
+      bytes += cluster.capacity() * sizeof(IndexType);
+    }
+  }
+  return bytes;
+}
+
+template <typename Graph>
+std::shared_ptr<LoadedGraph<Graph>> loadGraph(HyperGraphInput &input,
+                                              const MultilevelConfig &config) {
+  using IndexType = typename Graph::index_type;
+  using WeightType = typename Graph::weight_type;
+
+  TRACE_SCOPE(build_span, "build graph");
+  std::shared_ptr<LoadedGraph<Graph>> loaded(new LoadedGraph<Graph>());
+  if (config.reorder) {
+    CSR<IndexType> nets =
+        buildEdgeCSR<IndexType>(input.edges, input.nodes, config.threads);
+    size_t nodes_count =
+        *std::max_element(input.nodes.begin(), input.nodes.end()) + 1;
+    loaded->new_id = rcmOrder(nets, nodes_count, config.threads);
+    relabel(nets, loaded->new_id, config.threads);
+    std::vector<WeightType> w_edges(nets.rows(), 1);
+    std::vector<WeightType> w_nodes(nodes_count, 1);
+    loaded->graph.reset(new Graph(nets, w_edges, w_nodes, config.threads));
+  } else {
+    loaded->graph.reset(new Graph(input.edges, input.nodes, config.threads));
+  }
+  TRACE_ARG(build_span, "nodes", loaded->graph->weight_of_nodes->size());
+  TRACE_ARG(build_span, "edges", loaded->graph->edgeCount());
+
+  /* the flat pin lists are not needed once the graph is built */
+  std::vector<Index>().swap(input.edges);
+  std::vector<Index>().swap(input.nodes);
+  return loaded;
+}
+
+template <typename IndexType>
+void writePartition(const std::map<IndexType, int> &blocks,
+                    const std::string &path) {
+  std::ofstream output_file;
+  output_file.open(path);
+  for (auto i = blocks.begin(); i != blocks.end(); i++) {
+    output_file << i->first << " " << i->second - 1 << std::endl;
+  }
+  output_file.close();
+}
+
+template struct LoadedGraph<HyperGraph32>;
+template struct LoadedGraph<HyperGraph64>;
+template std::shared_ptr<LoadedGraph<HyperGraph32>>
+loadGraph<HyperGraph32>(HyperGraphInput &input,
+                        const MultilevelConfig &config);
+template std::shared_ptr<LoadedGraph<HyperGraph64>>
+loadGraph<HyperGraph64>(HyperGraphInput &input,
+                        const MultilevelConfig &config);
+template void writePartition<uint32_t>(const std::map<uint32_t, int> &blocks,
+                                       const std::string &path);
+template void writePartition<uint64_t>(const std::map<uint64_t, int> &blocks,
+                                       const std::string &path);
+
+} // namespace Partition
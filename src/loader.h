@@ -0,0 +1,50 @@
+#pragma once
+
+#include "coarsening.h"
+#include "definition.h"
+#include "parser_input.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Partition {
+
+/* a graph built from the data file, together with what is needed to answer
+ * in the ids of the file and the coarsening hierarchy once it was built */
+template <typename Graph> struct LoadedGraph {
+  using IndexType = typename Graph::index_type;
+
+  std::unique_ptr<Graph> graph;
+  /* new id of every node of the file, empty if the ids were kept */
+  std::vector<IndexType> new_id;
+
+  std::mutex hierarchy_mutex;
+  bool coarsened = false;
+  Hierarchy<Graph> hierarchy;
+
+  /* builds the hierarchy on the first call, later calls wait for it */
+  const Hierarchy<Graph> &getHierarchy(const MultilevelConfig &config);
+  /* fixes nodes given in the ids of the file, before anything is coarsened.
+   * Returns why they could not be fixed, empty if they were. */
+  std::string setFixed(const std::vector<std::pair<Index, int>> &nodes);
+  /* blocks of Multilevel back in the ids of the file */
+  std::map<IndexType, int>
+  toInputIds(const std::map<IndexType, int> &blocks) const;
+  /* the graph with its renumbering, and the levels below it */
+  size_t graphMemory() const;
+  size_t hierarchyMemory();
+};
+
+/* builds the graph, renumbered with --reorder, and frees the pin lists */
+template <typename Graph>
+std::shared_ptr<LoadedGraph<Graph>> loadGraph(HyperGraphInput &input,
+                                              const MultilevelConfig &config);
+
+/* one "id block" line per node, blocks counted from 0 */
+template <typename IndexType>
+void writePartition(const std::map<IndexType, int> &blocks,
+                    const std::string &path);
+
+}; // namespace Partition
@@ -1,31 +1,163 @@
 #include "coarsening.h"
 #include "definition.h"
 #include "fm_partition.h"
+#include "loader.h"
+#include "memory.h"
 #include "parser_input.h"
+#include "server.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
 #include <assert.h>
 #include <cstddef>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace Partition;
-int main(int argc, char *argv[]) {
-  assert(argc == 3);
 
-  float ratio = atof(argv[1]);
-  std::string path(argv[2]);
-  HyperGraph graph = readDataFromFile(path);
-  std::map<Index, int> result = Multilevel(graph, ratio, 8);
+/* false if the run could not start, the reason is printed */
+template <typename Graph>
+bool run(HyperGraphInput &input, const MultilevelConfig &config,
+         const FixedNodesInput &fixed) {
+  std::shared_ptr<LoadedGraph<Graph>> loaded = loadGraph<Graph>(input, config);
+  MemoryRecord graph_memory(GRAPH, loaded->graphMemory());
+  if (!fixed.nodes.empty()) {
+    std::string error = loaded->setFixed(fixed.nodes);
+    if (!error.empty()) {
+      std::cerr << error << std::endl;
+      return false;
+    }
+  }
+  Graph &graph = *loaded->graph;
+  std::map<typename Graph::index_type, int> result =
+      loaded->toInputIds(VCycles(graph, config));
 
-  std::ofstream output_file;
   std::ostringstream buffer;
   buffer << "output_" << graph.weight_of_nodes->size() << ".txt";
-  output_file.open(buffer.str());
-  for (auto i = result.begin(); i != result.end(); i++) {
-    output_file << i->first << " " << i->second - 1 << std::endl;
+  writePartition(result, buffer.str());
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> positional;
+  MultilevelConfig config;
+  config.threads = std::max(1u, std::thread::hardware_concurrency());
+  bool pin_threads = false;
+  bool serve = false;
+  std::string socket_path;
+  std::string fixed_path;
+  size_t workers = 2;
+  size_t cache_size = 4;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--memory-cap" && i + 1 < argc) {
+      /* in megabytes */
+      MemoryTracker::instance().setCap(atof(argv[++i]) * 1024 * 1024);
+    } else if (arg == "--contraction-limit" && i + 1 < argc) {
+      config.contraction_limit = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--cluster-size" && i + 1 < argc) {
+      config.cluster_size = std::max(2, atoi(argv[++i]));
+    } else if (arg == "--max-cluster-weight" && i + 1 < argc) {
+      config.max_cluster_weight = std::max(0, atoi(argv[++i]));
+    } else if (arg == "--min-shrink" && i + 1 < argc) {
+      config.min_shrink = atof(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      config.threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--pin-threads") {
+      pin_threads = true;
+    } else if (arg == "--vcycles" && i + 1 < argc) {
+      config.vcycles = std::max(0, atoi(argv[++i]));
+    } else if (arg == "--fixed" && i + 1 < argc) {
+      fixed_path = argv[++i];
+    } else if (arg == "--reorder") {
+      config.reorder = true;
+    } else if (arg == "--serve") {
+      serve = true;
+    } else if (arg == "--socket" && i + 1 < argc) {
+      serve = true;
+      socket_path = argv[++i];
+    } else if (arg == "--workers" && i + 1 < argc) {
+      workers = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--cache" && i + 1 < argc) {
+      cache_size = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--trace" && i + 1 < argc) {
+#if TRACE
+      Tracer::instance().open(argv[++i]);
+#else
+      i++;
+      std::cout << "--trace needs a build with -DTRACE=1, ignored"
+                << std::endl;
+#endif
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  /* every phase of every job runs on this pool */
+  ThreadPool &pool = ThreadPool::instance();
+  pool.start(config.threads, pin_threads);
+
+  if (serve) {
+    if (socket_path.empty()) {
+      /* stdout carries the replies, the log of the jobs goes to stderr */
+      std::ostream replies(std::cout.rdbuf());
+      std::cout.rdbuf(std::cerr.rdbuf());
+      {
+        Server server(config, workers, cache_size);
+        server.serve(std::cin, replies);
+      }
+      pool.report(std::cout);
+      std::cout.rdbuf(replies.rdbuf());
+    } else {
+      std::string error;
+      {
+        Server server(config, workers, cache_size);
+        error = server.serveSocket(socket_path);
+      }
+      if (!error.empty()) {
+        std::cerr << error << std::endl;
+        return 1;
+      }
+      pool.report(std::cout);
+    }
+    Tracer::instance().write();
+    return 0;
+  }
+
+  assert(positional.size() == 2);
+  config.ratio = atof(positional[0].c_str());
+  std::string path(positional[1]);
+  TRACE_SCOPE(parse_span, "parse");
+  HyperGraphInput input = readDataFromFile(path, config.threads);
+  TRACE_ARG(parse_span, "pins", input.nodes.size());
+  TRACE_STOP(parse_span);
+  if (!input.error.empty()) {
+    std::cerr << input.error << std::endl;
+    return 1;
+  }
+  FixedNodesInput fixed;
+  if (!fixed_path.empty()) {
+    fixed = readFixedNodes(fixed_path);
+    if (!fixed.error.empty()) {
+      std::cerr << fixed.error << std::endl;
+      return 1;
+    }
+  }
+
+  /* pick the narrowest index/weight width the input fits in */
+  bool done = input.fitsIn32Bits() ? run<HyperGraph32>(input, config, fixed)
+                                    : run<HyperGraph64>(input, config, fixed);
+  if (!done) {
+    return 1;
   }
-  output_file.close();
+  pool.report(std::cout);
+  Tracer::instance().write();
 
   return 0;
 }
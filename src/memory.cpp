@@ -0,0 +1,106 @@
+#include "memory.h"
+#include <algorithm>
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace Partition {
+
+MemoryTracker::MemoryTracker() {
+  for (int i = 0; i < SUBSYSTEMS; i++) {
+    current[i] = 0;
+    peak[i] = 0;
+  }
+}
+
+MemoryTracker &MemoryTracker::instance() {
+  static MemoryTracker tracker;
+  return tracker;
+}
+
+void MemoryTracker::add(Subsystem subsystem, size_t bytes) {
+  size_t now = current[subsystem] += bytes;
+  size_t seen = peak[subsystem];
+  while (now > seen && !peak[subsystem].compare_exchange_weak(seen, now)) {
+  }
+}
+
+void MemoryTracker::release(Subsystem subsystem, size_t bytes) {
+  /* never below zero, also with other records released at the same time */
+  size_t seen = current[subsystem];
+  while (!current[subsystem].compare_exchange_weak(
+      seen, seen - std::min(bytes, seen))) {
+  }
+}
+
+size_t MemoryTracker::usage(Subsystem subsystem) const {
+  return current[subsystem];
+}
+
+size_t MemoryTracker::total() const {
+  size_t result = 0;
+  for (int i = 0; i < SUBSYSTEMS; i++) {
+    result += current[i];
+  }
+  return result;
+}
+
+bool MemoryTracker::overCap(size_t extra) const {
+  if (cap == 0) {
+    return false;
+  }
+  /* the estimates miss allocator overhead, so trust the RSS when we have it */
+  size_t used = std::max(total(), currentRSS());
+  return used + extra > cap;
+}
+
+void MemoryTracker::report(std::ostream &os, const std::string &label) {
+  static const char *names[SUBSYSTEMS] = {"graph", "coarse levels",
+                                          "gain queue", "partitions"};
+  os << label << ":";
+  for (int i = 0; i < SUBSYSTEMS; i++) {
+    os << " " << names[i] << " " << peak[i] / 1024 << " KB"
+       << (i + 1 < SUBSYSTEMS ? "," : "");
+    peak[i] = size_t(current[i]);
+  }
+  os << " | peak RSS " << peakRSS() / 1024 << " KB" << std::endl;
+}
+
+MemoryRecord::MemoryRecord(Subsystem subsystem, size_t bytes)
+    : subsystem(subsystem) {
+  update(bytes);
+}
+
+MemoryRecord::~MemoryRecord() {
+  MemoryTracker::instance().release(subsystem, bytes);
+}
+
+void MemoryRecord::update(size_t updated) {
+  if (updated > bytes) {
+    MemoryTracker::instance().add(subsystem, updated - bytes);
+  } else {
+    MemoryTracker::instance().release(subsystem, bytes - updated);
+  }
+  bytes = updated;
+}
+
+size_t currentRSS() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+size_t peakRSS() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  /* kilobytes on linux */
+  return usage.ru_maxrss * 1024;
+}
+
+} // namespace Partition
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace Partition {
+
+enum Subsystem { GRAPH = 0, COARSE_LEVELS, GAIN_QUEUE, PARTITIONS, SUBSYSTEMS };
+
+/* estimated bytes held by each subsystem, the peaks are kept since the last
+ * report so every level of the multilevel recursion gets its own numbers */
+class MemoryTracker {
+private:
+  std::atomic<size_t> current[SUBSYSTEMS];
+  std::atomic<size_t> peak[SUBSYSTEMS];
+  size_t cap = 0;
+
+  MemoryTracker();
+
+public:
+  static MemoryTracker &instance();
+
+  void add(Subsystem subsystem, size_t bytes);
+  void release(Subsystem subsystem, size_t bytes);
+  size_t usage(Subsystem subsystem) const;
+  size_t total() const;
+
+  /* 0 means no cap */
+  void setCap(size_t bytes) { cap = bytes; }
+  size_t getCap() const { return cap; }
+  /* true when the process would go above the cap with extra more bytes */
+  bool overCap(size_t extra = 0) const;
+
+  void report(std::ostream &os, const std::string &label);
+};
+
+/* keeps bytes accounted to a subsystem for its own lifetime */
+class MemoryRecord {
+private:
+  Subsystem subsystem;
+  size_t bytes = 0;
+
+public:
+  MemoryRecord(Subsystem subsystem, size_t bytes = 0);
+  MemoryRecord(const MemoryRecord &) = delete;
+  MemoryRecord &operator=(const MemoryRecord &) = delete;
+  ~MemoryRecord();
+
+  void update(size_t updated);
+};
+
+/* resident set size of the process in bytes, 0 if unknown */
+size_t currentRSS();
+size_t peakRSS();
+
+/* rough size of a node of a std::set/std::map/std::list */
+const size_t TREE_NODE_OVERHEAD = 32;
+const size_t LIST_NODE_OVERHEAD = 16;
+
+}; // namespace Partition
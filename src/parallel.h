@@ -0,0 +1,45 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace Partition {
+
+/* run body(0) .. body(threads - 1) as tasks of the shared pool and wait for
+ * all, body(0) on the calling thread */
+inline void parallelRun(size_t threads,
+                        const std::function<void(size_t)> &body) {
+  if (threads <= 1) {
+    body(0);
+    return;
+  }
+
+  TaskGroup group;
+  for (size_t t = 1; t < threads; t++) {
+    group.run([&body, t]() { body(t); });
+  }
+  body(0);
+  group.wait();
+}
+
+/* split [begin, end) into one contiguous chunk per thread, body(from, to) */
+inline void parallelFor(size_t begin, size_t end, size_t threads,
+                        const std::function<void(size_t, size_t)> &body) {
+  if (end <= begin) {
+    return;
+  }
+  threads = std::max<size_t>(1, std::min(threads, end - begin));
+  size_t chunk = (end - begin + threads - 1) / threads;
+  parallelRun(threads, [&](size_t t) {
+    size_t from = begin + t * chunk;
+    size_t to = std::min(end, from + chunk);
+    if (from < to) {
+      body(from, to);
+    }
+  });
+}
+
+}; // namespace Partition
@@ -0,0 +1,373 @@
+#include "parallel_fm.h"
+#include "definition.h"
+#include "parallel.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <utility>
+
+namespace Partition {
+
+template <typename Graph>
+ParallelFM<Graph>::ParallelFM(std::set<IndexType> &part_1,
+                              std::set<IndexType> &part_2, Graph &graph,
+                              float ratio, size_t threads, int k,
+                              unsigned seed)
+    : graph(graph), threads(threads), part_1_area(0), move_count(0) {
+  std::cout << "part_1 size: " << part_1.size()
+            << "  part_2 size: " << part_2.size() << " (" << threads
+            << " threads)" << std::endl;
+  size_t nodes_count = graph.weight_of_nodes->size();
+  size_t edges_count = graph.bitMatrix.size();
+
+  side.reset(new std::atomic<uint8_t>[nodes_count]);
+  owner.reset(new std::atomic<uint32_t>[nodes_count]);
+  pin_count[0].reset(new std::atomic<IndexType>[edges_count]);
+  pin_count[1].reset(new std::atomic<IndexType>[edges_count]);
+  for (size_t i = 0; i < nodes_count; i++) {
+    side[i] = NO_SIDE;
+  }
+  for (auto n : part_1) {
+    side[n] = 0;
+  }
+  for (auto n : part_2) {
+    side[n] = 1;
+  }
+
+  WeightType total_area =
+      std::accumulate(graph.weight_of_nodes->begin(),
+                      graph.weight_of_nodes->end(), WeightType(0));
+  WeightType max_area = *std::max_element(graph.weight_of_nodes->begin(),
+                                          graph.weight_of_nodes->end());
+  target_area = ratio * total_area;
+  tolerance = max_area;
+  initPinCount();
+  rebalance();
+
+  std::default_random_engine rng(seed);
+  for (int round = 0; k == 0 || round < k; round++) {
+    TRACE_SCOPE(round_span, "parallel fm round");
+    TRACE_ARG(round_span, "round", round);
+    std::vector<uint8_t> initial_side(nodes_count);
+    std::vector<IndexType> seeds;
+    for (size_t i = 0; i < nodes_count; i++) {
+      initial_side[i] = side[i];
+      owner[i] = 0;
+      if (side[i] != NO_SIDE && !graph.isFixed(i) && isBoundary(i)) {
+        seeds.push_back(i);
+      }
+    }
+    /* spread the searches of the threads over the whole boundary */
+    std::shuffle(seeds.begin(), seeds.end(), rng);
+
+    moves.assign(nodes_count, Move());
+    move_count = 0;
+    memory.update(nodes_count * (sizeof(Move) + 2 * sizeof(IndexType)) +
+                  edges_count * 2 * sizeof(IndexType));
+    std::atomic<size_t> next_seed(0);
+    parallelRun(threads, [&](size_t t) {
+      TRACE_SCOPE(search_span, "localized searches");
+      size_t searches = 0;
+      size_t i = 0;
+      while ((i = next_seed++) < seeds.size()) {
+        localizedSearch(seeds[i], t + 1);
+        searches++;
+      }
+      TRACE_ARG(search_span, "searches", searches);
+    });
+
+    WeightType gain = rollback(initial_side);
+    TRACE_ARG(round_span, "seeds", seeds.size());
+    TRACE_ARG(round_span, "moves", move_count);
+    TRACE_ARG(round_span, "gain", gain);
+#if DEBUG
+    std::cout << "parallel FM round " << round << ": " << move_count
+              << " moves, gain " << gain << std::endl;
+#endif
+    if (gain <= 0) {
+      break;
+    }
+  }
+
+  part_1.clear();
+  part_2.clear();
+  for (size_t i = 0; i < nodes_count; i++) {
+    if (side[i] == 0) {
+      part_1.insert(i);
+    } else if (side[i] == 1) {
+      part_2.insert(i);
+    }
+  }
+}
+
+template <typename Graph> void ParallelFM<Graph>::initPinCount() {
+  auto &incidence = graph.incidence;
+  size_t nodes_count = graph.weight_of_nodes->size();
+  for (auto e = 0; e < graph.bitMatrix.size(); e++) {
+    pin_count[0][e] = 0;
+    pin_count[1][e] = 0;
+  }
+
+  WeightType area = 0;
+  for (size_t n = 0; n < nodes_count; n++) {
+    if (side[n] == NO_SIDE) {
+      continue;
+    }
+    if (side[n] == 0) {
+      area += graph.weight_of_nodes->at(n);
+    }
+    for (auto i = incidence.offsets[n]; i < incidence.offsets[n + 1]; i++) {
+      pin_count[side[n]][incidence.entries[i]]++;
+    }
+  }
+  part_1_area = area;
+}
+
+template <typename Graph>
+typename ParallelFM<Graph>::WeightType
+ParallelFM<Graph>::computeGain(IndexType node) {
+  auto &incidence = graph.incidence;
+  uint8_t from = side[node];
+  uint8_t to = 1 - from;
+  WeightType gain = 0;
+  for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1]; i++) {
+    IndexType e = incidence.entries[i];
+    WeightType edge_weight = graph.weight_of_edges->at(e);
+    if (pin_count[from][e] == 1) {
+      gain += edge_weight;
+    }
+    if (pin_count[to][e] == 0) {
+      gain -= edge_weight;
+    }
+  }
+
+  auto &two_pin = graph.twoPinNets;
+  for (auto i = two_pin.offsets[node]; i < two_pin.offsets[node + 1]; i++) {
+    uint8_t neighbor_side = side[two_pin.neighbors[i]];
+    if (neighbor_side == from) {
+      gain -= two_pin.neighbor_weights[i];
+    } else if (neighbor_side == to) {
+      gain += two_pin.neighbor_weights[i];
+    }
+  }
+  return gain;
+}
+
+template <typename Graph>
+bool ParallelFM<Graph>::isBoundary(IndexType node) {
+  auto &incidence = graph.incidence;
+  uint8_t to = 1 - side[node];
+  for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1]; i++) {
+    if (pin_count[to][incidence.entries[i]] > 0) {
+      return true;
+    }
+  }
+
+  auto &two_pin = graph.twoPinNets;
+  for (auto i = two_pin.offsets[node]; i < two_pin.offsets[node + 1]; i++) {
+    if (side[two_pin.neighbors[i]] == to) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Graph>
+bool ParallelFM<Graph>::isBalanced(WeightType area) const {
+  return area > target_area ? area - target_area <= tolerance
+                            : target_area - area <= tolerance;
+}
+
+template <typename Graph> void ParallelFM<Graph>::rebalance() {
+  if (isBalanced(part_1_area)) {
+    return;
+  }
+
+  /* move the best nodes of the heavier part over until the areas fit */
+  uint8_t from = part_1_area > target_area ? 0 : 1;
+  std::priority_queue<std::pair<WeightType, IndexType>> queue;
+  for (size_t i = 0; i < graph.weight_of_nodes->size(); i++) {
+    if (side[i] == from && !graph.isFixed(i)) {
+      queue.push(std::make_pair(computeGain(i), i));
+    }
+  }
+
+  while (!queue.empty() && !isBalanced(part_1_area)) {
+    auto top = queue.top();
+    queue.pop();
+    WeightType gain = computeGain(top.second);
+    if (gain < top.first) {
+      queue.push(std::make_pair(gain, top.second));
+      continue;
+    }
+    moveNode(top.second, from);
+    WeightType node_area = graph.weight_of_nodes->at(top.second);
+    part_1_area += from == 0 ? -node_area : node_area;
+  }
+}
+
+template <typename Graph>
+bool ParallelFM<Graph>::reserveArea(IndexType node, uint8_t from) {
+  WeightType node_area = graph.weight_of_nodes->at(node);
+  WeightType area = part_1_area;
+  while (true) {
+    WeightType updated = from == 0 ? area - node_area : area + node_area;
+    if (!isBalanced(updated)) {
+      return false;
+    }
+    if (part_1_area.compare_exchange_weak(area, updated)) {
+      return true;
+    }
+  }
+}
+
+template <typename Graph>
+void ParallelFM<Graph>::moveNode(IndexType node, uint8_t from) {
+  auto &incidence = graph.incidence;
+  uint8_t to = 1 - from;
+  side[node] = to;
+  for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1]; i++) {
+    pin_count[from][incidence.entries[i]]--;
+    pin_count[to][incidence.entries[i]]++;
+  }
+}
+
+template <typename Graph>
+void ParallelFM<Graph>::localizedSearch(IndexType seed, uint32_t id) {
+  auto &incidence = graph.incidence;
+  uint32_t free_owner = 0;
+  if (!owner[seed].compare_exchange_strong(free_owner, id)) {
+    return;
+  }
+
+  std::priority_queue<std::pair<WeightType, IndexType>> queue;
+  std::vector<IndexType> claimed({seed});
+  std::vector<size_t> local_moves;
+  queue.push(std::make_pair(computeGain(seed), seed));
+
+  auto claim = [&](IndexType node) {
+    uint32_t expected = 0;
+    if (side[node] != NO_SIDE && !graph.isFixed(node) &&
+        owner[node].compare_exchange_strong(expected, id)) {
+      claimed.push_back(node);
+      queue.push(std::make_pair(computeGain(node), node));
+    }
+  };
+
+  WeightType current_gain = 0;
+  WeightType best_gain = 0;
+  size_t best_moves = 0;
+  while (!queue.empty() && local_moves.size() - best_moves < FRUITLESS_LIMIT) {
+    auto top = queue.top();
+    queue.pop();
+    IndexType node = top.second;
+    /* other threads may have changed the neighborhood since it was queued */
+    WeightType gain = computeGain(node);
+    if (gain < top.first) {
+      queue.push(std::make_pair(gain, node));
+      continue;
+    }
+
+    uint8_t from = side[node];
+    if (!reserveArea(node, from)) {
+      continue;
+    }
+    moveNode(node, from);
+    size_t seq = move_count++;
+    moves[seq].node = node;
+    moves[seq].from = from;
+    moves[seq].valid = true;
+    local_moves.push_back(seq);
+
+    current_gain += gain;
+    if (current_gain > best_gain) {
+      best_gain = current_gain;
+      best_moves = local_moves.size();
+    }
+
+    for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1];
+         i++) {
+      IndexType e = incidence.entries[i];
+      if (graph.pins.rowSize(e) > EXPAND_LIMIT) {
+        continue;
+      }
+      for (auto p = graph.pins.offsets[e]; p < graph.pins.offsets[e + 1]; p++) {
+        claim(graph.pins.entries[p]);
+      }
+    }
+    auto &two_pin = graph.twoPinNets;
+    for (auto i = two_pin.offsets[node]; i < two_pin.offsets[node + 1]; i++) {
+      claim(two_pin.neighbors[i]);
+    }
+  }
+
+  /* take back the tail which did not pay off, the log keeps its slots */
+  for (size_t i = local_moves.size(); i > best_moves; i--) {
+    Move &m = moves[local_moves[i - 1]];
+    moveNode(m.node, 1 - m.from);
+    WeightType node_area = graph.weight_of_nodes->at(m.node);
+    part_1_area += m.from == 0 ? node_area : -node_area;
+    m.valid = false;
+  }
+
+  /* moved nodes stay locked for this round (also the rolled back ones, so
+   * every node owns at most one slot of the log), the others are released */
+  std::set<IndexType> moved;
+  for (auto seq : local_moves) {
+    moved.insert(moves[seq].node);
+  }
+  for (auto n : claimed) {
+    if (moved.find(n) == moved.end()) {
+      owner[n] = 0;
+    }
+  }
+}
+
+template <typename Graph>
+typename ParallelFM<Graph>::WeightType
+ParallelFM<Graph>::rollback(std::vector<uint8_t> &initial_side) {
+  for (size_t i = 0; i < initial_side.size(); i++) {
+    side[i] = initial_side[i];
+  }
+  initPinCount();
+
+  /* replay the global move sequence with exact gains */
+  size_t count = move_count;
+  WeightType current_gain = 0;
+  WeightType best_gain = 0;
+  size_t best_index = 0;
+  for (size_t i = 0; i < count; i++) {
+    Move &m = moves[i];
+    if (!m.valid) {
+      continue;
+    }
+    current_gain += computeGain(m.node);
+    moveNode(m.node, m.from);
+    WeightType node_area = graph.weight_of_nodes->at(m.node);
+    part_1_area += m.from == 0 ? -node_area : node_area;
+    if (current_gain > best_gain && isBalanced(part_1_area)) {
+      best_gain = current_gain;
+      best_index = i + 1;
+    }
+  }
+
+  for (size_t i = count; i > best_index; i--) {
+    Move &m = moves[i - 1];
+    if (!m.valid) {
+      continue;
+    }
+    moveNode(m.node, 1 - m.from);
+    WeightType node_area = graph.weight_of_nodes->at(m.node);
+    part_1_area += m.from == 0 ? node_area : -node_area;
+  }
+  return best_gain;
+}
+
+template class ParallelFM<HyperGraph32>;
+template class ParallelFM<HyperGraph64>;
+
+} // namespace Partition
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "definition.h"
+#include "memory.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace Partition {
+
+/* FM refinement running localized searches on several threads at once.
+ * Every search starts from a boundary seed, claims the nodes it touches and
+ * moves them directly on the shared partition, with pin counts and the area
+ * of part_1 kept in atomics. After a round all moves are replayed in their
+ * global order with exact gains, the best balanced prefix is kept and the
+ * rest is rolled back, so a round never makes the cut worse. A partition
+ * which is out of balance when it comes in is repaired greedily first.
+ * Fixed nodes of the graph are neither seeds nor claimed by a search. */
+template <typename Graph> class ParallelFM {
+private:
+  using IndexType = typename Graph::index_type;
+  using WeightType = typename Graph::weight_type;
+
+  /* side of a node which is in neither part (not covered by any net) */
+  static const uint8_t NO_SIDE = 2;
+  /* moves without improvement before a localized search gives up */
+  static const size_t FRUITLESS_LIMIT = 64;
+  /* nets larger than this are not used to grow a localized search */
+  static const size_t EXPAND_LIMIT = 256;
+
+  struct Move {
+    IndexType node;
+    uint8_t from;
+    bool valid;
+  };
+
+  Graph &graph;
+  size_t threads = 1;
+  WeightType target_area = 0;
+  WeightType tolerance = 0;
+
+  std::unique_ptr<std::atomic<uint8_t>[]> side;
+  std::unique_ptr<std::atomic<uint32_t>[]> owner;
+  std::unique_ptr<std::atomic<IndexType>[]> pin_count[2];
+  std::atomic<WeightType> part_1_area;
+
+  std::vector<Move> moves;
+  std::atomic<size_t> move_count;
+  MemoryRecord memory{GAIN_QUEUE};
+
+private:
+  void initPinCount();
+  WeightType computeGain(IndexType node);
+  bool isBoundary(IndexType node);
+  bool isBalanced(WeightType area) const;
+  void rebalance();
+  bool reserveArea(IndexType node, uint8_t from);
+  void moveNode(IndexType node, uint8_t from);
+  void localizedSearch(IndexType seed, uint32_t id);
+  WeightType rollback(std::vector<uint8_t> &initial_side);
+
+public:
+  ParallelFM(std::set<IndexType> &part_1, std::set<IndexType> &part_2,
+             Graph &graph, float ratio, size_t threads, int k,
+             unsigned seed = 0);
+};
+
+}; // namespace Partition
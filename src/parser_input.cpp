@@ -1,50 +1,180 @@
 #include "parser_input.h"
+#include "csr.h"
 #include "definition.h"
+#include "parallel.h"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <cstddef>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <string>
 
-Partition::HyperGraph Partition::readDataFromFile(std::string path) {
-  std::ifstream input;
-  input.open(path);
+/* numbers in [from, to) of a line, apart from the first one (the edge id).
+ * With out set they are stored there as 0-based pins. Like reading them
+ * with >>, the line ends at anything which is no number. valid is cleared
+ * for a pin outside of 1 .. nodes_count. */
+static size_t parsePins(const std::string &data, size_t from, size_t to,
+                        Partition::Index nodes_count, Partition::Index *out,
+                        bool &valid) {
+  size_t count = 0;
+  bool edge_id = true;
+  size_t i = from;
+  while (i < to) {
+    char c = data[i];
+    if (c == ' ' || c == '\t' || c == '\r') {
+      i++;
+      continue;
+    }
+    if (c < '0' || c > '9') {
+      break;
+    }
+    Partition::Index value = 0;
+    for (; i < to && data[i] >= '0' && data[i] <= '9'; i++) {
+      value = value * 10 + (data[i] - '0');
+    }
+    if (edge_id) {
+      /* edge id will not be used */
+      edge_id = false;
+      continue;
+    }
+    if (value == 0 || value > nodes_count) {
+      valid = false;
+    } else if (out != nullptr) {
+      out[count] = value - 1;
+    }
+    count++;
+  }
+  return count;
+}
 
-  assert(input.is_open());
+Partition::HyperGraphInput Partition::readDataFromFile(std::string path,
+                                                       size_t threads) {
+  HyperGraphInput result;
+  std::ifstream input;
+  input.open(path, std::ios::binary);
+  if (!input.is_open()) {
+    result.error = "cannot open " + path;
+    return result;
+  }
 
-  std::string line;
-  std::getline(input, line);
-  std::istringstream stream(line);
+  std::string data;
+  input.seekg(0, std::ios::end);
+  data.resize(input.tellg());
+  input.seekg(0, std::ios::beg);
+  input.read(&data[0], data.size());
 
-  Index edges_count = 0;
-  Index nodes_count = 0;
+  size_t position = std::min(data.find('\n'), data.size());
+  std::istringstream stream(data.substr(0, position));
 
-  stream >> edges_count >> nodes_count;
+  Index &edges_count = result.edges_count;
+  Index &nodes_count = result.nodes_count;
 
-  std::vector<Index> edges;
-  std::vector<Index> nodes;
+  if (!(stream >> edges_count >> nodes_count) || nodes_count == 0) {
+    result.error = "the first line needs the numbers of nets and nodes";
+    return result;
+  }
 
-  for (auto i = 0; i < edges_count; i++) {
-    std::string line;
-    std::getline(input, line);
-    if (line.empty()) {
+  /* the lines are found serially, their pins are parsed in parallel: once to
+   * count them and once more to store them where the counts say */
+  std::vector<std::pair<size_t, size_t>> lines;
+  position++;
+  while (lines.size() < edges_count && position < data.size()) {
+    size_t end = std::min(data.find('\n', position), data.size());
+    if (end == position) {
       break;
     }
-    std::istringstream stream(line);
-
-    Index edge_id = 0;
-    /* edge id will not be used */
-    stream >> edge_id;
+    lines.push_back(std::make_pair(position, end));
+    position = end + 1;
+  }
 
-    edges.push_back(nodes.size());
-    Index pin = 0;
-    while (stream >> pin) {
-      assert(pin <= nodes_count);
-      nodes.push_back(pin - 1);
+  std::vector<Index> offsets(lines.size() + 1, 0);
+  /* the first line with a bad pin, for the message */
+  std::atomic<size_t> bad_line(lines.size());
+  parallelFor(0, lines.size(), threads, [&](size_t from, size_t to) {
+    for (size_t l = from; l < to; l++) {
+      bool valid = true;
+      offsets[l + 1] = parsePins(data, lines[l].first, lines[l].second,
+                                 nodes_count, nullptr, valid);
+      size_t seen = bad_line;
+      while (!valid && l < seen &&
+             !bad_line.compare_exchange_weak(seen, l)) {
+      }
     }
+  });
+  if (bad_line < lines.size()) {
+    std::ostringstream message;
+    message << "line " << bad_line + 2 << ": pin out of 1.." << nodes_count;
+    result.error = message.str();
+    return result;
   }
+  parallelPrefixSum(offsets, threads);
+  if (offsets.back() == 0) {
+    result.error = "no pins in " + path;
+    return result;
+  }
+
+  std::vector<Index> &edges = result.edges;
+  std::vector<Index> &nodes = result.nodes;
+  nodes.resize(offsets.back());
+  parallelFor(0, lines.size(), threads, [&](size_t from, size_t to) {
+    for (size_t l = from; l < to; l++) {
+      bool valid = true;
+      parsePins(data, lines[l].first, lines[l].second, nodes_count,
+                nodes.data() + offsets[l], valid);
+    }
+  });
+  offsets.pop_back();
+  edges.swap(offsets);
 
   /* value in edges is the index of the start node of the nodes belonged to this
    * edge in nodes*/
-  return HyperGraph(edges, nodes);
+  return result;
+}
+
+Partition::FixedNodesInput Partition::readFixedNodes(std::string path) {
+  FixedNodesInput result;
+  std::ifstream input;
+  input.open(path);
+  if (!input.is_open()) {
+    result.error = "cannot open " + path;
+    return result;
+  }
+
+  /* the block every node got so far, 0 for none */
+  std::map<Index, int> seen;
+  std::string line;
+  for (size_t number = 1; std::getline(input, line); number++) {
+    std::istringstream stream(line);
+    Index node = 0;
+    int block = 0;
+    std::ostringstream message;
+    message << path << ":" << number << ": ";
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    if (!(stream >> node >> block)) {
+      result.error = message.str() + "expected \"id block\"";
+      return result;
+    }
+    if (block != 0 && block != 1) {
+      message << "block " << block << " of node " << node
+              << " is neither 0 nor 1";
+      result.error = message.str();
+      return result;
+    }
+    int &fixed = seen[node];
+    if (fixed == block + 1) {
+      continue;
+    }
+    if (fixed != 0) {
+      message << "node " << node << " is fixed to both blocks";
+      result.error = message.str();
+      return result;
+    }
+    fixed = block + 1;
+    result.nodes.push_back(std::make_pair(node, block + 1));
+  }
+  return result;
 }
@@ -2,9 +2,41 @@
 
 #include "definition.h"
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace Partition {
 
-HyperGraph readDataFromFile(std::string path);
+/* flat pin lists as they are read from the data file, the graph is built from
+ * them once we know which index/weight width is needed */
+struct HyperGraphInput {
+  std::vector<Index> edges;
+  std::vector<Index> nodes;
+  Index edges_count = 0;
+  Index nodes_count = 0;
+  /* why the file could not be read, empty if it was */
+  std::string error;
+
+  bool fitsIn32Bits() const {
+    /* every edge has weight one after parsing */
+    return Partition::fitsIn32Bits(nodes_count, nodes.size(), edges.size());
+  }
+};
+
+/* the lines are parsed in threads chunks on the shared pool */
+HyperGraphInput readDataFromFile(std::string path, size_t threads = 1);
+
+/* fixed nodes with blocks 1 and 2 as Multilevel numbers them */
+struct FixedNodesInput {
+  std::vector<std::pair<Index, int>> nodes;
+  /* why the file could not be read, empty if it was */
+  std::string error;
+};
+
+/* "id block" lines as in the output file, blocks counted from 0. Another
+ * block or a node given with both blocks is an error, a node given twice
+ * with the same block is kept once. The ids are checked against the graph
+ * by LoadedGraph::setFixed. */
+FixedNodesInput readFixedNodes(std::string path);
 
 };
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "csr.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace Partition {
+
+/* reverse Cuthill-McKee order of the nodes of a hypergraph given as net rows.
+ * Every component is walked breadth first from its node of lowest degree, the
+ * newly reached nodes are appended by increasing degree and the whole order is
+ * reversed at the end. A net is expanded only once, all its pins are reached
+ * by then. Returns the new id of every node. */
+template <typename IndexType>
+std::vector<IndexType> rcmOrder(const CSR<IndexType> &nets,
+                                size_t nodes_count, size_t threads) {
+  CSR<IndexType> incidence = transpose(nets, nodes_count, threads);
+  auto byDegree = [&incidence](IndexType a, IndexType b) {
+    return incidence.rowSize(a) < incidence.rowSize(b);
+  };
+
+  std::vector<IndexType> starts(nodes_count);
+  std::iota(starts.begin(), starts.end(), 0);
+  std::stable_sort(starts.begin(), starts.end(), byDegree);
+
+  std::vector<bool> visited(nodes_count, false);
+  std::vector<bool> expanded(nets.rows(), false);
+  std::vector<IndexType> order;
+  order.reserve(nodes_count);
+  for (auto start : starts) {
+    if (visited[start]) {
+      continue;
+    }
+    visited[start] = true;
+    order.push_back(start);
+    for (size_t head = order.size() - 1; head < order.size(); head++) {
+      IndexType node = order[head];
+      size_t reached = order.size();
+      for (auto i = incidence.offsets[node]; i < incidence.offsets[node + 1];
+           i++) {
+        IndexType e = incidence.entries[i];
+        if (expanded[e]) {
+          continue;
+        }
+        expanded[e] = true;
+        for (auto j = nets.offsets[e]; j < nets.offsets[e + 1]; j++) {
+          IndexType pin = nets.entries[j];
+          if (!visited[pin]) {
+            visited[pin] = true;
+            order.push_back(pin);
+          }
+        }
+      }
+      std::stable_sort(order.begin() + reached, order.end(), byDegree);
+    }
+  }
+
+  std::vector<IndexType> new_id(nodes_count);
+  for (size_t i = 0; i < nodes_count; i++) {
+    new_id[order[i]] = nodes_count - 1 - i;
+  }
+  return new_id;
+}
+
+/* renames the pins of every net, the rows stay sorted */
+template <typename IndexType>
+void relabel(CSR<IndexType> &nets, const std::vector<IndexType> &new_id,
+             size_t threads) {
+  parallelFor(0, nets.rows(), threads, [&](size_t from, size_t to) {
+    for (size_t e = from; e < to; e++) {
+      auto first = nets.entries.begin() + nets.offsets[e];
+      auto last = nets.entries.begin() + nets.offsets[e + 1];
+      for (auto pin = first; pin != last; pin++) {
+        *pin = new_id[*pin];
+      }
+      std::sort(first, last);
+    }
+  });
+}
+
+}; // namespace Partition
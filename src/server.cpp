@@ -0,0 +1,326 @@
+#include "server.h"
+#include "memory.h"
+#include "parser_input.h"
+#include "trace.h"
+#include <algorithm>
+#include <assert.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Partition {
+
+/* the socket is closed once the connection is done and no job of it is left
+ * to reply */
+struct Server::Connection {
+  int fd;
+  std::mutex mutex;
+
+  Connection(int fd) : fd(fd) {}
+  ~Connection() { close(fd); }
+
+  void send(const std::string &line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string data = line + "\n";
+    /* the client may be gone already, that must not kill the server */
+    ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+  }
+};
+
+Server::Server(const MultilevelConfig &config, size_t workers,
+               size_t cache_size)
+    : config(config), cache_size(std::max<size_t>(1, cache_size)), next_id(0),
+      stopping(false) {
+  for (size_t i = 0; i < std::max<size_t>(1, workers); i++) {
+    this->workers.push_back(std::thread(&Server::work, this));
+  }
+}
+
+Server::~Server() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    closing = true;
+  }
+  queue_changed.notify_all();
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+std::shared_ptr<Server::CacheEntry> Server::lookup(const std::string &path) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  for (auto iter = cache.begin(); iter != cache.end(); iter++) {
+    if ((*iter)->path == path) {
+      cache.splice(cache.begin(), cache, iter);
+      return cache.front();
+    }
+  }
+
+  std::shared_ptr<CacheEntry> entry(new CacheEntry());
+  entry->path = path;
+  cache.push_front(entry);
+  /* jobs still running on an evicted graph keep it alive until they end */
+  while (cache.size() > cache_size ||
+         (cache.size() > 1 && MemoryTracker::instance().overCap())) {
+    std::cout << "cache: dropping " << cache.back()->path << std::endl;
+    cache.pop_back();
+  }
+  return entry;
+}
+
+void Server::work() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_changed.wait(lock, [this]() { return closing || !queue.empty(); });
+      if (queue.empty()) {
+        return;
+      }
+      job = std::move(queue.front());
+      queue.pop_front();
+    }
+    runJob(job);
+  }
+}
+
+void Server::runJob(Job &job) {
+  std::ostringstream failed;
+  failed << "failed " << job.id << " ";
+  if (job.ratio <= 0 || job.ratio >= 1) {
+    job.reply(failed.str() + "ratio must be between 0 and 1");
+    return;
+  }
+  if (job.k != 2) {
+    job.reply(failed.str() + "k must be 2, only bisections are supported");
+    return;
+  }
+
+  std::shared_ptr<CacheEntry> entry = lookup(job.path);
+  {
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!entry->narrow && !entry->wide) {
+      TRACE_SCOPE(parse_span, "parse");
+      HyperGraphInput input = readDataFromFile(job.path, config.threads);
+      TRACE_STOP(parse_span);
+      if (!input.error.empty()) {
+        /* the next job on this path tries again */
+        job.reply(failed.str() + input.error);
+        return;
+      }
+      if (input.fitsIn32Bits()) {
+        entry->narrow = loadGraph<HyperGraph32>(input, config);
+        entry->graph_memory.update(entry->narrow->graphMemory());
+      } else {
+        entry->wide = loadGraph<HyperGraph64>(input, config);
+        entry->graph_memory.update(entry->wide->graphMemory());
+      }
+    }
+  }
+
+  if (entry->narrow) {
+    job.reply(partition(*entry, *entry->narrow, job));
+  } else {
+    job.reply(partition(*entry, *entry->wide, job));
+  }
+}
+
+template <typename Graph>
+std::string Server::partition(CacheEntry &entry, LoadedGraph<Graph> &loaded,
+                              const Job &job) {
+  TRACE_SCOPE(job_span, "job");
+  TRACE_ARG(job_span, "id", job.id);
+  MultilevelConfig job_config = config;
+  job_config.ratio = job.ratio;
+  job_config.seed = job.seed;
+  job_config.refinement_passes = job.passes;
+
+  /* the hierarchy does not depend on anything the job can change */
+  const Hierarchy<Graph> &hierarchy = loaded.getHierarchy(job_config);
+  {
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    entry.levels_memory.update(loaded.hierarchyMemory());
+  }
+  Graph &graph = *loaded.graph;
+  std::map<typename Graph::index_type, int> blocks =
+      VCycles(graph, job_config, &hierarchy);
+
+  std::ostringstream output;
+  output << "output_" << graph.weight_of_nodes->size() << "_" << job.id
+         << ".txt";
+  writePartition(loaded.toInputIds(blocks), output.str());
+
+  std::ostringstream reply;
+  reply << "done " << job.id << " " << cutSize(graph, blocks) << " "
+        << output.str();
+  return reply.str();
+}
+
+bool Server::handle(const std::string &line,
+                    const std::function<void(const std::string &)> &reply) {
+  std::istringstream stream(line);
+  std::string command;
+  if (!(stream >> command)) {
+    return true;
+  }
+  if (command == "quit") {
+    return false;
+  }
+  if (command == "shutdown") {
+    stopping = true;
+    return false;
+  }
+
+  Job job;
+  job.id = next_id++;
+  job.passes = config.refinement_passes;
+  job.reply = reply;
+  std::ostringstream answer;
+  if (command != "partition" || !(stream >> job.path >> job.ratio)) {
+    answer << "failed " << job.id
+           << " usage: partition <path> <ratio> [seed] [k] [passes]";
+    reply(answer.str());
+    return true;
+  }
+  /* a failed read would overwrite the defaults with 0 */
+  unsigned seed = 0;
+  int k = 0;
+  int passes = 0;
+  if (stream >> seed) {
+    job.seed = seed;
+    if (stream >> k) {
+      job.k = k;
+      if (stream >> passes) {
+        job.passes = passes;
+      }
+    }
+  }
+
+  answer << "queued " << job.id;
+  reply(answer.str());
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.push_back(std::move(job));
+  }
+  queue_changed.notify_one();
+  return true;
+}
+
+void Server::serve(std::istream &input, std::ostream &output) {
+  std::mutex output_mutex;
+  auto reply = [&output, &output_mutex](const std::string &line) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    output << line << std::endl;
+  };
+
+  std::string line;
+  while (std::getline(input, line) && handle(line, reply)) {
+  }
+
+  /* replies of the jobs still queued go to output as well */
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    closing = true;
+  }
+  queue_changed.notify_all();
+  for (auto &w : workers) {
+    w.join();
+  }
+  workers.clear();
+}
+
+void Server::serveConnection(std::shared_ptr<Connection> connection) {
+  auto reply = [connection](const std::string &line) {
+    connection->send(line);
+  };
+
+  std::string pending;
+  char buffer[4096];
+  bool open = true;
+  while (open) {
+    ssize_t got = read(connection->fd, buffer, sizeof(buffer));
+    if (got <= 0) {
+      break;
+    }
+    pending.append(buffer, got);
+    size_t end = 0;
+    while (open && (end = pending.find('\n')) != std::string::npos) {
+      open = handle(pending.substr(0, end), reply);
+      pending.erase(0, end + 1);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(connection_mutex);
+  open_connections--;
+  connection_closed.notify_all();
+}
+
+std::string Server::serveSocket(const std::string &path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return "socket path too long: " + path;
+  }
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    return std::string("socket: ") + strerror(errno);
+  }
+  unlink(path.c_str());
+  if (bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(listener, 16) != 0) {
+    std::string error = path + ": " + strerror(errno);
+    close(listener);
+    return error;
+  }
+  std::cout << "serving on " << path << std::endl;
+
+  std::vector<std::weak_ptr<Connection>> connections;
+  while (!stopping) {
+    /* wake up now and then to see whether a connection asked to shut down */
+    pollfd waiting = {listener, POLLIN, 0};
+    if (poll(&waiting, 1, 200) <= 0) {
+      continue;
+    }
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+
+    std::shared_ptr<Connection> connection(new Connection(fd));
+    connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                     [](const std::weak_ptr<Connection> &c) {
+                                       return c.expired();
+                                     }),
+                      connections.end());
+    connections.push_back(connection);
+    {
+      std::lock_guard<std::mutex> lock(connection_mutex);
+      open_connections++;
+    }
+    std::thread(&Server::serveConnection, this, connection).detach();
+  }
+  close(listener);
+  unlink(path.c_str());
+
+  /* connections still waiting for a line see the end of their input */
+  for (auto &c : connections) {
+    std::shared_ptr<Connection> connection = c.lock();
+    if (connection) {
+      shutdown(connection->fd, SHUT_RD);
+    }
+  }
+  std::unique_lock<std::mutex> lock(connection_mutex);
+  connection_closed.wait(lock, [this]() { return open_connections == 0; });
+  return "";
+}
+
+} // namespace Partition
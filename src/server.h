@@ -0,0 +1,108 @@
+#pragma once
+
+#include "coarsening.h"
+#include "definition.h"
+#include "loader.h"
+#include "memory.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Partition {
+
+/* one partition request, the reply is called from the worker running it */
+struct Job {
+  size_t id = 0;
+  std::string path;
+  float ratio = 0.5;
+  unsigned seed = 0;
+  /* the number of blocks, only bisections are supported */
+  int k = 2;
+  int passes = 2;
+  std::function<void(const std::string &)> reply;
+};
+
+/* resident mode: keeps the graphs of the most recently used files loaded,
+ * together with their coarsening hierarchies, and runs the jobs on a fixed
+ * set of workers. Jobs come as lines from stdin or from the connections of
+ * a unix socket:
+ *   partition <path> <ratio> [seed] [k] [passes]
+ *       ->  queued <id>
+ *           done <id> <cut> <output file>
+ *           failed <id> <reason>
+ *   quit      ends the input it came from
+ *   shutdown  stops accepting connections on the socket
+ * k is the number of blocks and has to be 2, passes the number of FM passes
+ * on every level. The seed picks the net the initial partitioning starts
+ * from and the order of the parallel FM searches. The output file has the
+ * same "id block" lines as the one written by the command line mode. */
+class Server {
+private:
+  struct Connection;
+  struct CacheEntry {
+    std::string path;
+    /* guards the loading, the graph is read-only afterwards */
+    std::mutex mutex;
+    std::shared_ptr<LoadedGraph<HyperGraph32>> narrow;
+    std::shared_ptr<LoadedGraph<HyperGraph64>> wide;
+    /* what the entry keeps resident, released when it is dropped and the
+     * last job on it is done */
+    MemoryRecord graph_memory{GRAPH};
+    MemoryRecord levels_memory{COARSE_LEVELS};
+  };
+
+  MultilevelConfig config;
+  size_t cache_size = 1;
+
+  std::mutex cache_mutex;
+  /* most recently used first */
+  std::list<std::shared_ptr<CacheEntry>> cache;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_changed;
+  std::deque<Job> queue;
+  bool closing = false;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next_id;
+  std::atomic<bool> stopping;
+
+  std::mutex connection_mutex;
+  std::condition_variable connection_closed;
+  size_t open_connections = 0;
+
+private:
+  std::shared_ptr<CacheEntry> lookup(const std::string &path);
+  void work();
+  void runJob(Job &job);
+  template <typename Graph>
+  std::string partition(CacheEntry &entry, LoadedGraph<Graph> &loaded,
+                        const Job &job);
+  /* false once the input should not be read any further */
+  bool handle(const std::string &line,
+              const std::function<void(const std::string &)> &reply);
+  void serveConnection(std::shared_ptr<Connection> connection);
+
+public:
+  /* config is the base of every job. The workers only pick up the jobs, the
+   * jobs running at the same time share the thread pool for their work. */
+  Server(const MultilevelConfig &config, size_t workers, size_t cache_size);
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+  /* waits for the queued jobs */
+  ~Server();
+
+  void serve(std::istream &input, std::ostream &output);
+  /* returns why the socket could not be set up, empty after a shutdown */
+  std::string serveSocket(const std::string &path);
+};
+
+}; // namespace Partition
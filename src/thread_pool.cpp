@@ -0,0 +1,215 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <assert.h>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Partition {
+
+static const size_t NOT_A_WORKER = static_cast<size_t>(-1);
+/* which deque the tasks submitted by this thread go to */
+static thread_local size_t current_worker = NOT_A_WORKER;
+/* a task waiting for a group runs other tasks inside of it, only the
+ * outermost one counts as busy time */
+static thread_local size_t running_depth = 0;
+
+/* binds the calling thread, cores are counted round */
+static void pinThread(size_t core) {
+#ifdef __linux__
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core % cores, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+ThreadPool::ThreadPool()
+    : queued(0), start_time(std::chrono::steady_clock::now()) {}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    closing = true;
+  }
+  wake.notify_all();
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+ThreadPool &ThreadPool::instance() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::start(size_t threads, bool pin) {
+  assert(workers.empty());
+  start_time = std::chrono::steady_clock::now();
+  threads = std::max<size_t>(1, threads);
+  /* every deque exists before anyone may steal from it */
+  for (size_t i = 0; i + 1 < threads; i++) {
+    queues.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+  this->pin = pin;
+  if (pin) {
+    pinThread(0);
+  }
+  for (size_t i = 0; i + 1 < threads; i++) {
+    workers.push_back(std::thread(&ThreadPool::work, this, i));
+  }
+}
+
+void ThreadPool::work(size_t id) {
+  current_worker = id;
+  if (pin) {
+    pinThread(id + 1);
+  }
+  while (true) {
+    if (runOne(id)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [this]() { return closing || queued > 0; });
+    if (closing && queued == 0) {
+      return;
+    }
+  }
+}
+
+bool ThreadPool::take(size_t id, Task &task, bool &stolen) {
+  if (queued == 0) {
+    return false;
+  }
+  auto popBack = [this, &task](Queue &queue) -> bool {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    queued--;
+    return true;
+  };
+  auto popFront = [this, &task](Queue &queue) -> bool {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    queued--;
+    return true;
+  };
+
+  stolen = false;
+  size_t count = queues.size();
+  if (id < count && popBack(*queues[id])) {
+    return true;
+  }
+  if (popFront(outside)) {
+    return true;
+  }
+  size_t first = id < count ? id + 1 : 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t victim = (first + i) % count;
+    if (victim != id && popFront(*queues[victim])) {
+      stolen = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::runOne(size_t id) {
+  Task task;
+  bool stolen = false;
+  if (!take(id, task, stolen)) {
+    return false;
+  }
+
+  Queue &stats = id < queues.size() ? *queues[id] : outside;
+  auto begin = std::chrono::steady_clock::now();
+  running_depth++;
+  task();
+  running_depth--;
+  if (running_depth == 0) {
+    stats.busy += std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+  }
+  stats.executed++;
+  if (stolen) {
+    stats.stolen++;
+  }
+  return true;
+}
+
+void ThreadPool::submit(Task task) {
+  size_t id = current_worker;
+  Queue &queue = id < queues.size() ? *queues[id] : outside;
+  /* counted before it can be taken, a take running queued-- first would
+   * wrap the counter */
+  queued++;
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    /* a worker checking queued right now is asleep once this gets the lock */
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+  }
+  wake.notify_one();
+}
+
+bool ThreadPool::runPending() { return runOne(current_worker); }
+
+void ThreadPool::report(std::ostream &os) {
+  long long wall = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count();
+  wall = std::max(1ll, wall);
+  auto line = [&os, wall](const std::string &name, const Queue &queue) {
+    os << "  " << name << ": " << queue.executed << " tasks (" << queue.stolen
+       << " stolen), busy " << queue.busy / 1000 << " ms, "
+       << 100 * queue.busy / wall << "%" << std::endl;
+  };
+
+  os << "thread pool: " << threads() << " threads over " << wall / 1000
+     << " ms" << std::endl;
+  for (size_t i = 0; i < queues.size(); i++) {
+    line("worker " + std::to_string(i), *queues[i]);
+  }
+  line("waiting threads", outside);
+}
+
+void TaskGroup::run(std::function<void()> task) {
+  pending++;
+  ThreadPool::instance().submit([this, task]() {
+    task();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0) {
+      done.notify_all();
+    }
+  });
+}
+
+void TaskGroup::wait() {
+  ThreadPool &pool = ThreadPool::instance();
+  while (pending > 0) {
+    if (pool.runPending()) {
+      continue;
+    }
+    /* more tasks may be queued meanwhile, look again now and then */
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait_for(lock, std::chrono::milliseconds(1),
+                  [this]() { return pending == 0; });
+  }
+  /* the task which finished last may still hold the mutex */
+  std::lock_guard<std::mutex> lock(mutex);
+}
+
+} // namespace Partition
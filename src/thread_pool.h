@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace Partition {
+
+/* the one scheduler every parallel phase submits its tasks to. Every worker
+ * has its own deque: it takes its newest task first and steals the oldest
+ * one of another worker when its own deque is empty. Tasks submitted from
+ * outside of the pool go to a shared deque. A thread waiting for a TaskGroup
+ * runs queued tasks meanwhile, so groups can be nested inside tasks. */
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    /* for the utilization report, busy is in microseconds */
+    std::atomic<size_t> executed;
+    std::atomic<size_t> stolen;
+    std::atomic<long long> busy;
+
+    Queue() : executed(0), stolen(0), busy(0) {}
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  /* tasks of threads which are not workers, and what those threads ran */
+  Queue outside;
+  std::vector<std::thread> workers;
+
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  std::atomic<size_t> queued;
+  bool closing = false;
+  bool pin = false;
+  std::chrono::steady_clock::time_point start_time;
+
+  ThreadPool();
+  ~ThreadPool();
+
+  void work(size_t id);
+  bool take(size_t id, Task &task, bool &stolen);
+  bool runOne(size_t id);
+
+public:
+  static ThreadPool &instance();
+
+  /* starts threads - 1 workers, the thread waiting for a group makes up the
+   * last one. Without a start every task runs on the thread waiting for it.
+   * pin binds the workers to cores in order, the calling thread to the
+   * first. */
+  void start(size_t threads, bool pin);
+  size_t threads() const { return workers.size() + 1; }
+
+  void submit(Task task);
+  /* runs one queued task, false if there was none */
+  bool runPending();
+  /* tasks and busy time of every worker since start */
+  void report(std::ostream &os);
+};
+
+/* fork/join on the pool: run forks a task, wait joins all of them */
+class TaskGroup {
+private:
+  std::atomic<size_t> pending;
+  std::mutex mutex;
+  std::condition_variable done;
+
+public:
+  TaskGroup() : pending(0) {}
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+  ~TaskGroup() { wait(); }
+
+  void run(std::function<void()> task);
+  void wait();
+};
+
+}; // namespace Partition
@@ -0,0 +1,98 @@
+#include "trace.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace Partition {
+
+Tracer::Tracer() : start(std::chrono::steady_clock::now()) {}
+
+Tracer &Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::open(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->path = path;
+}
+
+long long Tracer::now() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void Tracer::record(const char *name, long long begin, long long end,
+                    const std::vector<std::pair<const char *, double>> &args) {
+  if (!enabled()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = thread_ids.find(std::this_thread::get_id());
+  if (found == thread_ids.end()) {
+    found = thread_ids
+                .insert(std::make_pair(std::this_thread::get_id(),
+                                       thread_ids.size()))
+                .first;
+  }
+
+  std::ostringstream event;
+  event << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+        << found->second << ",\"ts\":" << begin << ",\"dur\":" << end - begin
+        << ",\"args\":{";
+  for (size_t i = 0; i < args.size(); i++) {
+    event << (i > 0 ? "," : "") << "\"" << args[i].first
+          << "\":" << args[i].second;
+  }
+  event << "}}";
+  events.push_back(event.str());
+}
+
+void Tracer::write() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (path.empty()) {
+    return;
+  }
+
+  std::ofstream output(path);
+  output << "{\"traceEvents\":[" << std::endl;
+  for (size_t i = 0; i < events.size(); i++) {
+    output << events[i] << (i + 1 < events.size() ? "," : "") << std::endl;
+  }
+  output << "]}" << std::endl;
+  std::cout << "trace: " << events.size() << " events written to " << path
+            << std::endl;
+}
+
+TraceSpan::TraceSpan(const char *name)
+    : name(name), begin(Tracer::instance().now()) {}
+
+void TraceSpan::arg(const char *key, double value) {
+  for (auto &a : args) {
+    if (a.first == key) {
+      a.second = value;
+      return;
+    }
+  }
+  args.push_back(std::make_pair(key, value));
+}
+
+void TraceSpan::restart() {
+  finish();
+  args.clear();
+  stopped = false;
+  begin = Tracer::instance().now();
+}
+
+void TraceSpan::stop() { finish(); }
+
+void TraceSpan::finish() {
+  if (!stopped) {
+    Tracer::instance().record(name, begin, Tracer::instance().now(), args);
+    stopped = true;
+  }
+}
+
+} // namespace Partition
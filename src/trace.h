@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Partition {
+
+/* collects complete ("X") events and writes them as Chrome/Perfetto
+ * trace-event JSON, open the file with chrome://tracing or ui.perfetto.dev */
+class Tracer {
+private:
+  std::mutex mutex;
+  std::string path;
+  std::vector<std::string> events;
+  std::map<std::thread::id, size_t> thread_ids;
+  std::chrono::steady_clock::time_point start;
+
+  Tracer();
+
+public:
+  static Tracer &instance();
+
+  void open(const std::string &path);
+  bool enabled() const { return !path.empty(); }
+  /* microseconds since the tracer was created */
+  long long now() const;
+  void record(const char *name, long long begin, long long end,
+              const std::vector<std::pair<const char *, double>> &args);
+  void write();
+};
+
+/* one span from construction to destruction (or to restart) */
+class TraceSpan {
+private:
+  const char *name;
+  long long begin;
+  bool stopped = false;
+  std::vector<std::pair<const char *, double>> args;
+
+public:
+  TraceSpan(const char *name);
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+  ~TraceSpan() { finish(); }
+
+  void arg(const char *key, double value);
+  /* close the span and open the next one with the same name */
+  void restart();
+  /* close the span before the end of its scope */
+  void stop();
+
+private:
+  void finish();
+};
+
+}; // namespace Partition
+
+/* everything compiles down to nothing unless built with -DTRACE=1 */
+#if TRACE
+#define TRACE_SCOPE(span, name) Partition::TraceSpan span(name)
+#define TRACE_ARG(span, key, value) span.arg(key, value)
+#define TRACE_NEXT(span) span.restart()
+#define TRACE_STOP(span) span.stop()
+#else
+#define TRACE_SCOPE(span, name)
+#define TRACE_ARG(span, key, value)
+#define TRACE_NEXT(span)
+#define TRACE_STOP(span)
+#endif